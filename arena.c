@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+  size_t used;
+  alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align(size_t size)
+{
+  return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+  ArenaBlock *block = arena->blocks;
+  size_t block_size;
+
+  size = align(size ? size : 1);
+  if (block == NULL || block->size - block->used < size) {
+    block_size = size > ARENA_BLOCK_SIZE - sizeof(ArenaBlock) ? size : ARENA_BLOCK_SIZE - sizeof(ArenaBlock);
+    block = malloc(sizeof(ArenaBlock) + block_size);
+    if (block == NULL)
+      err(EXIT_FAILURE, "Memory allocation failed");
+    block->size = block_size;
+    block->used = 0;
+
+    /* keep filling the current block after a large request */
+    if (arena->blocks && size > ARENA_BLOCK_SIZE - sizeof(ArenaBlock)) {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    } else {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+  }
+
+  block->used += size;
+  return block->data + block->used - size;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t len)
+{
+  char *copy = arena_alloc(arena, len + 1);
+
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *s)
+{
+  return arena_strndup(arena, s, strlen(s));
+}
+
+void arena_free(Arena *arena)
+{
+  ArenaBlock *next;
+
+  for (ArenaBlock *block = arena->blocks; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+  arena->blocks = NULL;
+}
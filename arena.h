@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* size of the blocks an arena grows by, larger requests get their own block */
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct ArenaBlock ArenaBlock;
+
+/* memory released all at once, zero initialize before use */
+typedef struct Arena {
+  ArenaBlock *blocks;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *s);
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+void arena_free(Arena *arena);
+
+#endif
@@ -6,193 +6,558 @@
 #include <dirent.h>
 #include <err.h>
 #include <errno.h>
-#include <math.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "battery.h"
+#include "stats.h"
 
-static char *attr_path = NULL;
+static char *power_supply_path = POWER_SUPPLY_SUBSYSTEM;
+static char **include_patterns = NULL;
+static int include_count = 0;
+static char **exclude_patterns = NULL;
+static int exclude_count = 0;
+static int subsystem_dir = -1;
+static bool mixed_warned = false;
 
-static void set_attributes(char *battery_name, char **now_attribute, char **full_attribute)
+static void set_attributes(Battery *bat)
 {
-  sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/charge_now", battery_name);
-  if (access(attr_path, F_OK) == 0) {
-    *now_attribute = "charge_now";
-    *full_attribute = "charge_full";
+  if (faccessat(bat->dir, "charge_now", F_OK, 0) == 0) {
+    bat->now_attribute = "charge_now";
+    bat->full_attribute = "charge_full";
+    bat->rate_attribute = "current_now";
+    bat->design_attribute = "charge_full_design";
+  } else if (faccessat(bat->dir, "energy_now", F_OK, 0) == 0) {
+    bat->now_attribute = "energy_now";
+    bat->full_attribute = "energy_full";
+    bat->rate_attribute = "power_now";
+    bat->design_attribute = "energy_full_design";
   } else {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/energy_now", battery_name);
-    if (access(attr_path, F_OK) == 0) {
-      *now_attribute = "energy_now";
-      *full_attribute = "energy_full";
-    } else {
-      *now_attribute = "capacity";
-      *full_attribute = NULL;
-    }
+    bat->now_attribute = "capacity";
+    bat->full_attribute = NULL;
+    bat->rate_attribute = NULL;
+    bat->design_attribute = NULL;
   }
 }
 
-static bool is_type_battery(char *name)
+static bool read_attribute(int fd, char *buf, size_t size)
+{
+  ssize_t len = pread(fd, buf, size - 1, 0);
+
+  stats.sysfs_reads++;
+  if (len < 0)
+    return false;
+  stats.bytes_read += len;
+  while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+    len--;
+  buf[len] = '\0';
+  return len > 0;
+}
+
+/* read a short attribute relative to a directory */
+static bool read_text(int dir, char *name, char *attribute, char *buf, size_t size)
+{
+  char path[NAME_MAX + POWER_SUPPLY_ATTR_LENGTH + 2];
+  bool result;
+  int fd;
+
+  if (snprintf(path, sizeof(path), "%s/%s", name, attribute) >= (int)sizeof(path))
+    return false;
+  fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  result = read_attribute(fd, buf, size);
+  close(fd);
+  return result;
+}
+
+static bool is_type_battery(int dir, char *name)
 {
-  FILE *file;
-  char type[11] = "";
+  char type[POWER_SUPPLY_ATTR_LENGTH];
+
+  return read_text(dir, name, "type", type, sizeof(type)) && strcmp(type, "Battery") == 0;
+}
 
-  sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/type", name);
-  file = fopen(attr_path, "r");
-  if (file != NULL) {
-    if (fscanf(file, "%10s", type) == 0) { /* Continue... */ }
-    fclose(file);
+static bool matches(char *name, char **patterns, int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (fnmatch(patterns[i], name, 0) == 0)
+      return true;
   }
-  return strcmp(type, "Battery") == 0;
+  return false;
 }
 
-static bool has_capacity_field(char *name)
+/* whether discovery should use the battery, before it is opened */
+static bool is_wanted(int dir, char *name)
 {
-  FILE *file;
-  int capacity = -1;
-  char *now_attribute;
-  char *full_attribute;
+  char scope[POWER_SUPPLY_ATTR_LENGTH];
 
-  set_attributes(name, &now_attribute, &full_attribute);
+  if (name[0] == '.' || matches(name, exclude_patterns, exclude_count))
+    return false;
+  if (include_count > 0)
+    return matches(name, include_patterns, include_count) && is_type_battery(dir, name);
 
-  if (strcmp(now_attribute, "capacity") == 0) {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/capacity", name);
-    file = fopen(attr_path, "r");
-    if (file != NULL) {
-      if (fscanf(file, "%d", &capacity) == 0) { /* Continue... */ }
-      fclose(file);
-    }
+  /* peripherals such as mice and headsets report a device scope */
+  return is_type_battery(dir, name) &&
+    !(read_text(dir, name, "scope", scope, sizeof(scope)) && strcmp(scope, "Device") == 0);
+}
+
+/* largest magnitude read_int() accepts, which fits both long and unsigned int */
+#define READ_INT_MAX (LONG_MAX < UINT_MAX ? (unsigned long)LONG_MAX : UINT_MAX)
+
+static bool read_int(int fd, long *value)
+{
+  char buf[24];
+  char *p = buf;
+  char *digits;
+  unsigned long result = 0;
+
+  if (!read_attribute(fd, buf, sizeof(buf)))
+    return false;
+
+  if (*p == '-')
+    p++;
+  for (digits = p; *p >= '0' && *p <= '9'; p++) {
+    /* checked before multiplying, so the result never overflows */
+    if (result > (READ_INT_MAX - (*p - '0')) / 10)
+      break;
+    result = result * 10 + (*p - '0');
+  }
+  if (p == digits || *p != '\0') {
+    errno = EINVAL;
+    return false;
+  }
+
+  *value = buf[0] == '-' ? -(long)result : (long)result;
+  return true;
+}
+
+static bool read_uint(int fd, unsigned int *value)
+{
+  long result;
+
+  if (!read_int(fd, &result))
+    return false;
+  if (result < 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  *value = result;
+  return true;
+}
+
+/* read an attribute that does not change while the battery is present */
+static unsigned int read_constant(int dir, char *attribute)
+{
+  unsigned int value;
+  int fd = openat(dir, attribute, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return 0;
+  if (!read_uint(fd, &value))
+    value = 0;
+  close(fd);
+  return value;
+}
+
+/* the design voltage, or the present voltage for drivers that report none */
+static unsigned int read_voltage(int dir)
+{
+  unsigned int voltage = read_constant(dir, "voltage_min_design");
+
+  if (voltage == 0)
+    voltage = read_constant(dir, "voltage_max_design");
+  return voltage ? voltage : read_constant(dir, "voltage_now");
+}
+
+/* convert charge (uAh, uA) to energy (uWh, uW) when the voltage is known */
+static unsigned int to_energy(Battery *bat, unsigned long value)
+{
+  uint64_t energy;
+
+  if (bat->voltage == 0)
+    return value;
+  energy = (uint64_t)value * bat->voltage / 1000000;
+  return energy > UINT_MAX ? UINT_MAX : energy;
+}
+
+static void reset_health(Battery *bat)
+{
+  bat->cycle_count = 0;
+  bat->health_sampled = 0;
+  bat->health_since = 0;
+  bat->health_start = 0;
+  bat->wear_tenths = 0;
+  bat->health_low = false;
+}
+
+static void init_battery(Battery *bat, char *name)
+{
+  bat->name = name;
+  bat->now_attribute = NULL;
+  bat->full_attribute = NULL;
+  bat->rate_attribute = NULL;
+  bat->design_attribute = NULL;
+  bat->voltage = 0;
+  bat->unit = UNIT_PERCENT;
+  bat->energy_design = 0;
+  bat->dir = -1;
+  bat->status = -1;
+  bat->now = -1;
+  bat->full = -1;
+  bat->rate = -1;
+  bat->status_text[0] = '\0';
+  bat->energy_now = 0;
+  bat->energy_full = 0;
+  bat->energy_rate = 0;
+  bat->discharging = false;
+  bat->level_tenths = 0;
+  bat->health_tenths = 0;
+  bat->low = false;
+  reset_health(bat);
+}
+
+static void close_battery(Battery *bat)
+{
+  if (bat->status >= 0)
+    close(bat->status);
+  if (bat->now >= 0)
+    close(bat->now);
+  if (bat->full >= 0)
+    close(bat->full);
+  if (bat->rate >= 0)
+    close(bat->rate);
+  if (bat->dir >= 0)
+    close(bat->dir);
+  bat->dir = bat->status = bat->now = bat->full = bat->rate = -1;
+}
+
+static bool open_subsystem()
+{
+  if (subsystem_dir < 0)
+    subsystem_dir = open(power_supply_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  return subsystem_dir >= 0;
+}
+
+static bool open_battery(Battery *bat)
+{
+  if (!open_subsystem())
+    return false;
+
+  bat->dir = openat(subsystem_dir, bat->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (bat->dir < 0)
+    return false;
+
+  /* a replaced pack may expose a different attribute family */
+  set_attributes(bat);
+  bat->voltage = 0;
+  if (strcmp(bat->now_attribute, "energy_now") == 0) {
+    bat->unit = UNIT_ENERGY;
+  } else if (strcmp(bat->now_attribute, "charge_now") == 0) {
+    bat->voltage = read_voltage(bat->dir);
+    bat->unit = bat->voltage ? UNIT_ENERGY : UNIT_CHARGE;
+    if (bat->voltage == 0)
+      warnx("Battery %s reports no voltage, its charge cannot be converted to energy", bat->name);
   } else {
-    capacity = 1;
+    bat->unit = UNIT_PERCENT;
+  }
+  bat->energy_design = bat->design_attribute ? to_energy(bat, read_constant(bat->dir, bat->design_attribute)) : 0;
+
+  bat->status = openat(bat->dir, "status", O_RDONLY | O_CLOEXEC);
+  bat->now = openat(bat->dir, bat->now_attribute, O_RDONLY | O_CLOEXEC);
+  if (bat->full_attribute != NULL)
+    bat->full = openat(bat->dir, bat->full_attribute, O_RDONLY | O_CLOEXEC);
+  /* the rate attribute is optional */
+  if (bat->rate_attribute != NULL)
+    bat->rate = openat(bat->dir, bat->rate_attribute, O_RDONLY | O_CLOEXEC);
+
+  if (bat->status < 0 || bat->now < 0 || (bat->full_attribute != NULL && bat->full < 0)) {
+    close_battery(bat);
+    return false;
   }
-  return capacity >= 0;
+  return true;
 }
 
-static bool is_battery(char *name)
+static bool has_capacity_field(Battery *bat)
 {
-  return is_type_battery(name) && has_capacity_field(name);
+  unsigned int capacity;
+
+  return bat->full_attribute != NULL || read_uint(bat->now, &capacity);
+}
+
+static bool open_usable(Battery *bat)
+{
+  if (open_battery(bat)) {
+    if (has_capacity_field(bat))
+      return true;
+    close_battery(bat);
+  }
+  return false;
+}
+
+static bool is_battery(Battery *bat)
+{
+  return open_subsystem() && is_type_battery(subsystem_dir, bat->name) && open_usable(bat);
 }
 
-int find_batteries(char ***battery_names)
+/* copy the battery set into a new arena, leaving out skip and adding added */
+static void rebuild(BatteryState *battery, int skip, Battery *added)
+{
+  Arena arena = { NULL };
+  int size = battery->count + 1;
+  char **names = arena_alloc(&arena, sizeof(char *) * size);
+  Battery *batteries = arena_alloc(&arena, sizeof(Battery) * size);
+  int count = 0;
+
+  for (int i = 0; i < battery->count; i++) {
+    if (i != skip)
+      batteries[count++] = battery->batteries[i];
+  }
+  if (added)
+    batteries[count++] = *added;
+  for (int i = 0; i < count; i++)
+    names[i] = batteries[i].name = arena_strdup(&arena, batteries[i].name);
+
+  arena_free(&battery->arena);
+  battery->arena = arena;
+  battery->names = names;
+  battery->batteries = batteries;
+  battery->count = count;
+  battery->generation++;
+}
+
+void set_power_supply_path(char *path)
+{
+  power_supply_path = path;
+  if (subsystem_dir >= 0) {
+    close(subsystem_dir);
+    subsystem_dir = -1;
+  }
+}
+
+void set_battery_filter(char **include, int include_len, char **exclude, int exclude_len)
+{
+  include_patterns = include;
+  include_count = include_len;
+  exclude_patterns = exclude;
+  exclude_count = exclude_len;
+}
+
+void close_batteries(Battery *batteries, int battery_count)
+{
+  for (int i = 0; i < battery_count; i++)
+    close_battery(&batteries[i]);
+}
+
+int find_batteries(char ***battery_names, Battery **batteries, Arena *arena)
 {
-  unsigned int path_len = strlen(POWER_SUPPLY_SUBSYSTEM) + POWER_SUPPLY_ATTR_LENGTH;
-  unsigned int entry_name_len = 5;
   int battery_count = 0;
+  int capacity = 0;
   DIR *dir;
   struct dirent *entry;
+  Battery bat;
+  char **names;
+  Battery *grown;
 
-  attr_path = realloc(attr_path, path_len + entry_name_len);
-
-  dir = opendir(POWER_SUPPLY_SUBSYSTEM);
-  if (dir) {
-    while ((entry = readdir(dir)) != NULL) {
-      if (strlen(entry->d_name) > entry_name_len) {
-        entry_name_len = strlen(entry->d_name);
-        attr_path = realloc(attr_path, path_len + entry_name_len);
-        if (attr_path == NULL)
-          err(EXIT_FAILURE, "Memory allocation failed");
-      }
+  if (!open_subsystem())
+    return 0;
+  dir = opendir(power_supply_path);
+  if (dir == NULL)
+    return 0;
 
-      if (is_battery(entry->d_name)) {
-        *battery_names = realloc(*battery_names, sizeof(char *) * (battery_count+1));
-        if (*battery_names == NULL)
-          err(EXIT_FAILURE, "Memory allocation failed");
-        (*battery_names)[battery_count] = strdup(entry->d_name);
-        if ((*battery_names)[battery_count] == NULL)
-          err(EXIT_FAILURE, "Memory allocation failed");
-        battery_count++;
+  while ((entry = readdir(dir)) != NULL) {
+    if (!is_wanted(subsystem_dir, entry->d_name))
+      continue;
+    init_battery(&bat, entry->d_name);
+    if (open_usable(&bat)) {
+      /* double the arrays, the arena keeps the old ones until it is released */
+      if (battery_count == capacity) {
+        capacity = capacity ? capacity * 2 : 4;
+        names = arena_alloc(arena, sizeof(char *) * capacity);
+        grown = arena_alloc(arena, sizeof(Battery) * capacity);
+        if (battery_count > 0) {
+          memcpy(names, *battery_names, sizeof(char *) * battery_count);
+          memcpy(grown, *batteries, sizeof(Battery) * battery_count);
+        }
+        *battery_names = names;
+        *batteries = grown;
       }
+      (*battery_names)[battery_count] = arena_strdup(arena, entry->d_name);
+      bat.name = (*battery_names)[battery_count];
+      (*batteries)[battery_count] = bat;
+      battery_count++;
     }
-    closedir(dir);
   }
+  closedir(dir);
 
   return battery_count;
 }
 
-int validate_batteries(char **battery_names, int battery_count)
+/* add a battery that appeared, if discovery would have found it */
+bool add_battery(BatteryState *battery, char *name)
 {
-  unsigned int path_len = strlen(POWER_SUPPLY_SUBSYSTEM) + POWER_SUPPLY_ATTR_LENGTH;
-  unsigned int name_len = 5;
-  int return_value = -1;
+  Battery bat;
 
-  attr_path = realloc(attr_path, path_len + name_len);
+  for (int i = 0; i < battery->count; i++) {
+    if (strcmp(battery->names[i], name) == 0)
+      return false;
+  }
 
-  for (int i = 0; i < battery_count; i++) {
-    if (strlen(battery_names[i]) > name_len) {
-      name_len = strlen(battery_names[i]);
-      attr_path = realloc(attr_path, path_len + name_len);
-      if (attr_path == NULL)
-        err(EXIT_FAILURE, "Memory allocation failed");
+  init_battery(&bat, name);
+  if (!open_subsystem() || !is_wanted(subsystem_dir, name) || !open_usable(&bat))
+    return false;
+  rebuild(battery, -1, &bat);
+  return true;
+}
+
+bool remove_battery(BatteryState *battery, char *name)
+{
+  for (int i = 0; i < battery->count; i++) {
+    if (strcmp(battery->names[i], name) == 0) {
+      close_battery(&battery->batteries[i]);
+      rebuild(battery, i, NULL);
+      return true;
     }
-    if (!is_battery(battery_names[i]) && return_value < 0) {
+  }
+  return false;
+}
+
+int validate_batteries(char ***battery_names, int battery_count, Battery **batteries, Arena *arena)
+{
+  char **names = arena_alloc(arena, sizeof(char *) * battery_count);
+  int return_value = -1;
+
+  /* copy the names, the batteries may outlive the configuration */
+  *batteries = arena_alloc(arena, sizeof(Battery) * battery_count);
+  for (int i = 0; i < battery_count; i++) {
+    names[i] = arena_strdup(arena, (*battery_names)[i]);
+    init_battery(&(*batteries)[i], names[i]);
+    if (!is_battery(&(*batteries)[i]) && return_value < 0) {
       return_value = i;
     }
   }
+  *battery_names = names;
   return return_value;
 }
 
 void update_battery_state(BatteryState *battery, bool required)
 {
-  char state[15];
-  char *now_attribute;
-  char *full_attribute;
   unsigned int tmp_now;
   unsigned int tmp_full;
-  FILE *file;
+  long tmp_rate;
+  int unit = -1;
+  bool mixed = false;
+  Battery *bat;
 
   battery->discharging = false;
   battery->full = true;
   battery->energy_now = 0;
   battery->energy_full = 0;
-  set_attributes(battery->names[0], &now_attribute, &full_attribute);
+  battery->energy_rate = 0;
+  battery->has_rate = true;
+  battery->present = 0;
 
   /* iterate through all batteries */
   for (int i = 0; i < battery->count; i++) {
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/status", battery->names[i]);
-    file = fopen(attr_path, "r");
-    if (file == NULL || fscanf(file, "%12s", state) == 0) {
+    bat = &battery->batteries[i];
+
+    /* reopen batteries that were removed or not present at startup */
+    if (bat->dir < 0 && !open_battery(bat)) {
       if (required)
-        err(EXIT_FAILURE, "Could not read %s", attr_path);
-      battery->discharging |= 0;
-      if (file)
-        fclose(file);
+        err(EXIT_FAILURE, "Could not open battery %s", bat->name);
       continue;
     }
-    fclose(file);
 
-    battery->discharging |= strcmp(state, POWER_SUPPLY_DISCHARGING) == 0;
-    battery->full &= strcmp(state, POWER_SUPPLY_FULL) == 0;
+    if (!read_attribute(bat->status, bat->status_text, sizeof(bat->status_text))) {
+      if (required)
+        err(EXIT_FAILURE, "Could not read %s/status", bat->name);
+      close_battery(bat);
+      continue;
+    }
 
-    sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/%s", battery->names[i], now_attribute);
-    file = fopen(attr_path, "r");
-    if (file == NULL || fscanf(file, "%u", &tmp_now) == 0) {
+    if (!read_uint(bat->now, &tmp_now)) {
       if (required)
-        err(EXIT_FAILURE, "Could not read %s", attr_path);
-      if (file)
-        fclose(file);
+        err(EXIT_FAILURE, "Could not read %s/%s", bat->name, bat->now_attribute);
+      close_battery(bat);
       continue;
     }
-    fclose(file);
 
-    if (full_attribute != NULL) {
-      sprintf(attr_path, POWER_SUPPLY_SUBSYSTEM "/%s/%s", battery->names[i], full_attribute);
-      file = fopen(attr_path, "r");
-      if (file == NULL || fscanf(file, "%u", &tmp_full) == 0) {
+    if (bat->full_attribute != NULL) {
+      if (!read_uint(bat->full, &tmp_full)) {
         if (required)
-          err(EXIT_FAILURE, "Could not read %s", attr_path);
-        if (file)
-          fclose(file);
+          err(EXIT_FAILURE, "Could not read %s/%s", bat->name, bat->full_attribute);
+        close_battery(bat);
         continue;
       }
-      fclose(file);
     } else {
       tmp_full = 100;
     }
 
-    battery->energy_now += tmp_now;
-    battery->energy_full += tmp_full;
+    /* drivers disagree on the sign of the rate, so only use its magnitude */
+    if (bat->rate >= 0 && read_int(bat->rate, &tmp_rate)) {
+      bat->energy_rate = to_energy(bat, labs(tmp_rate));
+      battery->energy_rate += bat->energy_rate;
+    } else {
+      bat->energy_rate = 0;
+      battery->has_rate = false;
+    }
+
+    /* only a pack read completely counts towards the combined status */
+    bat->discharging = strcmp(bat->status_text, POWER_SUPPLY_DISCHARGING) == 0;
+    battery->discharging |= bat->discharging;
+    battery->full &= strcmp(bat->status_text, POWER_SUPPLY_FULL) == 0;
+
+    bat->energy_now = to_energy(bat, tmp_now);
+    bat->energy_full = to_energy(bat, tmp_full);
+    bat->level_tenths = bat->energy_full ? ((uint64_t)bat->energy_now * 1000 + bat->energy_full / 2) / bat->energy_full : 0;
+    bat->health_tenths = bat->energy_design ? (uint64_t)bat->energy_full * 1000 / bat->energy_design : 0;
+    battery->energy_now += bat->energy_now;
+    battery->energy_full += bat->energy_full;
+    battery->present++;
+
+    mixed |= unit >= 0 && bat->unit != unit;
+    unit = bat->unit;
   }
 
-  battery->level = round(100.0 * battery->energy_now / battery->energy_full);
+  /* amounts in different units cannot be summed, so weigh each battery equally */
+  if (mixed) {
+    if (!mixed_warned)
+      warnx("Batteries report different units, combining their levels");
+    mixed_warned = true;
+    battery->energy_now = 0;
+    battery->energy_full = 0;
+    battery->has_rate = false;
+    for (int i = 0; i < battery->count; i++) {
+      if (battery->batteries[i].dir >= 0 && battery->batteries[i].energy_full > 0) {
+        battery->energy_now += battery->batteries[i].level_tenths;
+        battery->energy_full += 1000;
+      }
+    }
+  }
+  battery->in_energy = !mixed && unit == UNIT_ENERGY;
+
+  /* without a readable battery, report neither full nor discharging */
+  if (battery->energy_full <= 0) {
+    battery->discharging = false;
+    battery->full = false;
+    battery->has_rate = false;
+    battery->level = 0;
+    battery->level_tenths = 0;
+    return;
+  }
+
+  /* round to the nearest tenth and whole percent in integer arithmetic */
+  battery->level_tenths = (battery->energy_now * 1000 + battery->energy_full / 2) / battery->energy_full;
+  battery->level = (battery->energy_now * 100 + battery->energy_full / 2) / battery->energy_full;
+}
+
+/* the cycle count only changes over days, so it is read when health is sampled */
+void read_cycle_count(Battery *bat)
+{
+  bat->cycle_count = bat->dir >= 0 ? read_constant(bat->dir, "cycle_count") : 0;
 }
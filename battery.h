@@ -6,6 +6,8 @@
 #define BATTERY_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
 
 /* battery states */
 #define STATE_AC 0
@@ -24,20 +26,95 @@
 
 #define POWER_SUPPLY_ATTR_LENGTH 15
 
+/* units a battery reports its levels in */
+#define UNIT_ENERGY 0  /* uWh and uW, or charge converted with the voltage */
+#define UNIT_CHARGE 1  /* uAh and uA, the voltage is unknown */
+#define UNIT_PERCENT 2 /* capacity only */
+
+/* attributes and open sysfs handles for a single battery */
+typedef struct Battery {
+  char *name;
+  char *now_attribute;
+  char *full_attribute;
+  char *rate_attribute;
+  char *design_attribute;
+  unsigned int voltage;
+  int unit;
+
+  /* design capacity read when the battery is opened, 0 if unknown */
+  unsigned int energy_design;
+  int dir;
+  int status;
+  int now;
+  int full;
+  int rate;
+
+  /* values from the last check */
+  char status_text[POWER_SUPPLY_ATTR_LENGTH];
+  unsigned int energy_now;
+  unsigned int energy_full;
+  unsigned int energy_rate;
+  bool discharging;
+
+  /* level and energy_full against energy_design, in tenths of a percent */
+  int level_tenths;
+  int health_tenths;
+
+  /* below the pack warning level, kept by the caller */
+  bool low;
+
+  /* sampled by the health monitor, kept while the battery is in use */
+  unsigned int cycle_count;
+  int64_t health_sampled;
+  int64_t health_since;
+  int health_start;
+  int wear_tenths;
+  bool health_low;
+} Battery;
+
 /* battery information */
 typedef struct BatteryState {
   char **names;
+  Battery *batteries;
   int count;
+
+  /* holds the names and batteries above */
+  Arena arena;
+
+  /* follow batteries added and removed, and count the changes */
+  bool hotplug;
+  unsigned int generation;
+
   bool discharging;
   bool full;
   char state;
   int level;
-  int energy_full;
-  int energy_now;
+
+  /* level in tenths of a percent */
+  int level_tenths;
+
+  /* number of batteries read by the last check */
+  int present;
+
+  /*
+   * summed over all batteries, in uWh and uW when in_energy. Batteries
+   * reporting different units add their level in tenths of a percent instead.
+   */
+  int64_t energy_full;
+  int64_t energy_now;
+  int64_t energy_rate;
+  bool has_rate;
+  bool in_energy;
 } BatteryState;
 
-int find_batteries(char ***battery_names);
-int validate_batteries(char **battery_names, int battery_count);
+void set_power_supply_path(char *path);
+void set_battery_filter(char **include, int include_len, char **exclude, int exclude_len);
+bool add_battery(BatteryState *battery, char *name);
+bool remove_battery(BatteryState *battery, char *name);
+int find_batteries(char ***battery_names, Battery **batteries, Arena *arena);
+int validate_batteries(char ***battery_names, int battery_count, Battery **batteries, Arena *arena);
+void close_batteries(Battery *batteries, int battery_count);
 void update_battery_state(BatteryState *battery, bool required);
+void read_cycle_count(Battery *bat);
 
 #endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Sends notifications by calling org.freedesktop.Notifications directly
+ * over sd-bus instead of through libnotify.
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdint.h>
+#include <string.h>
+#include <systemd/sd-bus.h>
+#include "bus.h"
+
+static sd_bus *bus = NULL;
+static char *bus_appname = NULL;
+static char *bus_icon = NULL;
+static int bus_expires = NOTIFY_EXPIRES_NEVER;
+static uint32_t notification_id = 0;
+
+/* connect on first use so startup never waits for the session bus */
+static bool bus_connect()
+{
+  int r;
+
+  if (bus != NULL)
+    return true;
+
+  r = sd_bus_open_user(&bus);
+  if (r < 0) {
+    warnx("Could not connect to the session bus: %s", strerror(-r));
+    bus = NULL;
+    return false;
+  }
+  sd_bus_set_method_call_timeout(bus, BUS_CALL_TIMEOUT);
+  return true;
+}
+
+/* drop a broken connection so the next call reconnects */
+static void bus_failed(char *method, sd_bus_error *error, int r)
+{
+  warnx("Could not call %s: %s", method, error->message ? error->message : strerror(-r));
+  sd_bus_error_free(error);
+  if (!sd_bus_is_open(bus)) {
+    bus = sd_bus_flush_close_unref(bus);
+    notification_id = 0;
+  }
+}
+
+void bus_init(char *appname, char *icon, int expires)
+{
+  bus_appname = appname;
+  bus_icon = icon ? icon : "";
+  bus_expires = expires;
+}
+
+bool bus_notify(char *summary, char *body, NotifyUrgency urgency)
+{
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+  sd_bus_message *reply = NULL;
+  uint32_t id;
+  int r;
+
+  if (!bus_connect())
+    return false;
+
+  /* replace the previous notification instead of stacking a new one */
+  r = sd_bus_call_method(bus, BUS_SERVICE, BUS_PATH, BUS_INTERFACE, "Notify",
+      &error, &reply, "susssasa{sv}i",
+      bus_appname, notification_id, bus_icon, summary, body,
+      0,
+      1, "urgency", "y", (uint8_t)urgency,
+      bus_expires);
+  if (r < 0) {
+    bus_failed("Notify", &error, r);
+    return false;
+  }
+
+  if (sd_bus_message_read(reply, "u", &id) >= 0)
+    notification_id = id;
+  sd_bus_message_unref(reply);
+  return true;
+}
+
+void bus_close_notification()
+{
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+  int r;
+
+  if (bus == NULL || notification_id == 0)
+    return;
+
+  r = sd_bus_call_method(bus, BUS_SERVICE, BUS_PATH, BUS_INTERFACE,
+      "CloseNotification", &error, NULL, "u", notification_id);
+  if (r < 0)
+    bus_failed("CloseNotification", &error, r);
+  notification_id = 0;
+}
+
+void bus_uninit()
+{
+  bus = sd_bus_flush_close_unref(bus);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdbool.h>
+
+#define BUS_SERVICE "org.freedesktop.Notifications"
+#define BUS_PATH "/org/freedesktop/Notifications"
+#define BUS_INTERFACE "org.freedesktop.Notifications"
+
+/* microseconds to wait for the notification server to reply */
+#define BUS_CALL_TIMEOUT 5000000
+
+/* the same values libnotify uses */
+#define NOTIFY_EXPIRES_DEFAULT -1
+#define NOTIFY_EXPIRES_NEVER 0
+
+typedef enum {
+  NOTIFY_URGENCY_LOW,
+  NOTIFY_URGENCY_NORMAL,
+  NOTIFY_URGENCY_CRITICAL
+} NotifyUrgency;
+
+void bus_init(char *appname, char *icon, int expires);
+bool bus_notify(char *summary, char *body, NotifyUrgency urgency);
+void bus_close_notification();
+void bus_uninit();
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "battery.h"
+#include "control.h"
+#include "estimate.h"
+#include "loop.h"
+#include "options.h"
+#include "stats.h"
+#include "threshold.h"
+
+typedef struct Client {
+  int fd;
+  bool subscribed;
+} Client;
+
+static Config *control_config = NULL;
+static BatteryState *control_battery = NULL;
+static Client clients[CONTROL_MAX_CLIENTS];
+
+/* batteries reply, grown with the number of batteries */
+static char *batteries_reply = NULL;
+static size_t batteries_size = 0;
+static char *state_names[] = { "ac", "discharging", "warning", "critical", "danger", "full" };
+
+/* last state pushed to subscribers */
+static int last_level = -1;
+static char last_state = -1;
+static bool last_discharging = false;
+
+static void reply(int fd, char *message)
+{
+  if (send(fd, message, strlen(message), MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno != EAGAIN)
+    warn("Could not send control reply");
+}
+
+static void format_state(BatteryState *battery, char *buf, size_t size)
+{
+  double remaining = estimate_time_to_level(battery, battery->discharging ? 0 : 1000);
+
+  snprintf(buf, size,
+      "level=%d\nlevel_tenths=%d\nstate=%s\ndischarging=%d\nenergy_now=%lld\nenergy_full=%lld\ntime_remaining=%lld\n",
+      battery->level,
+      battery->level_tenths,
+      battery->state <= STATE_FULL ? state_names[(int)battery->state] : "unknown",
+      battery->discharging,
+      (long long)battery->energy_now,
+      (long long)battery->energy_full,
+      remaining < 0 ? -1 : (long long)remaining);
+}
+
+/* the reply for all batteries, NULL if it could not be allocated */
+static char *format_batteries(BatteryState *battery)
+{
+  size_t size = CONTROL_BATTERY_LENGTH * (battery->count + 1);
+  size_t len = 0;
+  char *buf;
+  Battery *bat;
+
+  if (size > batteries_size) {
+    buf = realloc(batteries_reply, size);
+    if (buf == NULL)
+      return NULL;
+    batteries_reply = buf;
+    batteries_size = size;
+  }
+
+  buf = batteries_reply;
+  buf[0] = '\0';
+  for (int i = 0; i < battery->count && len < batteries_size; i++) {
+    bat = &battery->batteries[i];
+    len += snprintf(buf + len, batteries_size - len,
+        "name=%s present=%d status=%s level_tenths=%d energy_now=%u energy_full=%u "
+        "energy_full_design=%u energy_rate=%u health_tenths=%d wear_tenths=%d cycle_count=%u attribute=%s\n",
+        bat->name,
+        bat->dir >= 0,
+        bat->status_text[0] ? bat->status_text : "Unknown",
+        bat->level_tenths,
+        bat->energy_now,
+        bat->energy_full,
+        bat->energy_design,
+        bat->energy_rate,
+        bat->health_tenths,
+        bat->wear_tenths,
+        bat->cycle_count,
+        bat->now_attribute ? bat->now_attribute : "none");
+  }
+  return buf;
+}
+
+static void set_level(int fd, char *args)
+{
+  char error[OPTIONS_ERROR_LENGTH];
+  char message[OPTIONS_ERROR_LENGTH + 8];
+  char name[16];
+  char text[16];
+  Threshold value;
+  Config config = *control_config;
+
+  if (sscanf(args, "%15s %15s", name, text) != 2) {
+    reply(fd, "error Usage: set warning|critical|danger|full LEVEL");
+    return;
+  }
+
+  threshold_parse(text, &value);
+  if (strcmp(name, "warning") == 0)
+    config.warning = value;
+  else if (strcmp(name, "critical") == 0)
+    config.critical = value;
+  else if (strcmp(name, "danger") == 0)
+    config.danger = value;
+  else if (strcmp(name, "full") == 0)
+    config.full = value;
+  else {
+    reply(fd, "error Unknown level");
+    return;
+  }
+
+  /* levels are validated with the same rules as the command line */
+  if (!check_options(&config, error, sizeof(error))) {
+    snprintf(message, sizeof(message), "error %s", error);
+    reply(fd, message);
+    return;
+  }
+
+  *control_config = config;
+  loop_request_check();
+  reply(fd, "ok");
+}
+
+static void close_client(Client *client)
+{
+  loop_remove(client->fd);
+  close(client->fd);
+  client->fd = -1;
+  client->subscribed = false;
+}
+
+static void client_handler(int fd, void *data)
+{
+  Client *client = data;
+  char request[CONTROL_MESSAGE_LENGTH];
+  char response[CONTROL_MESSAGE_LENGTH];
+  char *batteries;
+  ssize_t len;
+
+  stats.wakeups[STATS_SOCKET]++;
+  len = recv(fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+  if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (len <= 0) {
+    close_client(client);
+    return;
+  }
+
+  while (len > 0 && (request[len - 1] == '\n' || request[len - 1] == '\r'))
+    len--;
+  request[len] = '\0';
+
+  if (strcmp(request, "state") == 0) {
+    format_state(control_battery, response, sizeof(response));
+    reply(fd, response);
+  } else if (strcmp(request, "batteries") == 0) {
+    batteries = format_batteries(control_battery);
+    reply(fd, batteries ? batteries : "error Out of memory");
+  } else if (strcmp(request, "refresh") == 0) {
+    loop_request_check();
+    reply(fd, "ok");
+  } else if (strcmp(request, "subscribe") == 0) {
+    client->subscribed = true;
+    reply(fd, "ok");
+  } else if (strncmp(request, "set ", 4) == 0) {
+    set_level(fd, request + 4);
+  } else {
+    reply(fd, "error Unknown command");
+  }
+}
+
+static void accept_handler(int fd, void *data)
+{
+  int client_fd;
+  int i;
+
+  stats.wakeups[STATS_SOCKET]++;
+  while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    for (i = 0; i < CONTROL_MAX_CLIENTS && clients[i].fd >= 0; i++);
+    if (i == CONTROL_MAX_CLIENTS) {
+      close(client_fd);
+      continue;
+    }
+    clients[i].fd = client_fd;
+    clients[i].subscribed = false;
+    loop_add(client_fd, client_handler, &clients[i]);
+  }
+}
+
+void control_init(Config *config, BatteryState *battery)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  int fd;
+  int probe;
+
+  control_config = config;
+  control_battery = battery;
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    clients[i].fd = -1;
+
+  if (runtime_dir == NULL || runtime_dir[0] == '\0')
+    return;
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/" CONTROL_SOCKET_FILE, runtime_dir) >= (int)sizeof(addr.sun_path)) {
+    warnx("Control socket path is too long");
+    return;
+  }
+
+  /* remove a stale socket left behind by a previous instance */
+  probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (probe >= 0) {
+    if (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno == ECONNREFUSED)
+      unlink(addr.sun_path);
+    close(probe);
+  }
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    warn("Could not create control socket");
+    return;
+  }
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, CONTROL_MAX_CLIENTS) < 0) {
+    warn("Could not bind control socket %s", addr.sun_path);
+    close(fd);
+    return;
+  }
+
+  loop_add(fd, accept_handler, NULL);
+}
+
+void control_update(BatteryState *battery)
+{
+  char message[CONTROL_MESSAGE_LENGTH];
+
+  if (battery->level == last_level && battery->state == last_state && battery->discharging == last_discharging)
+    return;
+  last_level = battery->level;
+  last_state = battery->state;
+  last_discharging = battery->discharging;
+
+  format_state(battery, message, sizeof(message));
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    if (clients[i].fd >= 0 && clients[i].subscribed)
+      reply(clients[i].fd, message);
+  }
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <limits.h>
+#include "battery.h"
+#include "options.h"
+
+#define CONTROL_SOCKET_FILE "batsignal.sock"
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_MESSAGE_LENGTH 1024
+
+/* longest line of the batteries reply, with a battery name up to NAME_MAX */
+#define CONTROL_BATTERY_LENGTH (NAME_MAX + 384)
+
+void control_init(Config *config, BatteryState *battery);
+void control_update(BatteryState *battery);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <time.h>
+#include "battery.h"
+#include "debounce.h"
+#include "stats.h"
+
+static long long settle_ms = 0;
+static bool stable = false;
+static bool reported = false;
+static long long changed = 0;
+static bool pending = false;
+
+static long long now_ms()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+void debounce_init(unsigned int settle, BatteryState *battery)
+{
+  settle_ms = settle * 1000LL;
+  stable = reported = battery->discharging;
+  pending = false;
+}
+
+/* hold back a change of the charging status until it has lasted the settle time */
+void debounce_update(BatteryState *battery)
+{
+  if (settle_ms == 0)
+    return;
+
+  /* restart the settle time whenever the reported status changes */
+  if (battery->discharging != reported) {
+    reported = battery->discharging;
+    changed = now_ms();
+    if (pending)
+      stats.debounced++;
+    pending = reported != stable;
+  }
+
+  if (pending && now_ms() - changed >= settle_ms) {
+    stable = reported;
+    pending = false;
+  }
+  battery->discharging = stable;
+}
+
+bool debounce_pending()
+{
+  return pending;
+}
+
+/* check often until a pending transition has settled */
+unsigned int debounce_interval(unsigned int duration)
+{
+  if (pending && (duration == 0 || duration > DEBOUNCE_BURST_INTERVAL))
+    return DEBOUNCE_BURST_INTERVAL;
+  return duration;
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+/* interval (seconds) of the checks made while a transition settles */
+#define DEBOUNCE_BURST_INTERVAL 1
+
+void debounce_init(unsigned int settle, BatteryState *battery);
+void debounce_update(BatteryState *battery);
+bool debounce_pending();
+unsigned int debounce_interval(unsigned int duration);
+
+#endif
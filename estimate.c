@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <time.h>
+#include "battery.h"
+#include "estimate.h"
+
+typedef struct Sample {
+  double time;
+  double energy;
+} Sample;
+
+static Sample samples[ESTIMATE_SAMPLES];
+static int sample_count = 0;
+static int sample_next = 0;
+static bool sample_discharging = false;
+static double reported_rate = 0;
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* least-squares slope of energy over time for the sample history */
+static double history_rate()
+{
+  double mean_time = 0;
+  double mean_energy = 0;
+  double covariance = 0;
+  double variance = 0;
+
+  if (sample_count < 2)
+    return 0;
+
+  for (int i = 0; i < sample_count; i++) {
+    mean_time += samples[i].time;
+    mean_energy += samples[i].energy;
+  }
+  mean_time /= sample_count;
+  mean_energy /= sample_count;
+
+  for (int i = 0; i < sample_count; i++) {
+    covariance += (samples[i].time - mean_time) * (samples[i].energy - mean_energy);
+    variance += (samples[i].time - mean_time) * (samples[i].time - mean_time);
+  }
+
+  return variance > 0 ? covariance / variance : 0;
+}
+
+void estimate_reset()
+{
+  sample_count = 0;
+  sample_next = 0;
+  reported_rate = 0;
+}
+
+void estimate_add_sample(BatteryState *battery)
+{
+  double rate;
+
+  /* history from the other direction is useless */
+  if (battery->discharging != sample_discharging) {
+    sample_discharging = battery->discharging;
+    estimate_reset();
+  }
+
+  samples[sample_next].time = now();
+  samples[sample_next].energy = battery->energy_now;
+  sample_next = (sample_next + 1) % ESTIMATE_SAMPLES;
+  if (sample_count < ESTIMATE_SAMPLES)
+    sample_count++;
+
+  /* rate attributes are per hour, energy is tracked per second */
+  if (battery->has_rate) {
+    rate = battery->energy_rate / 3600.0;
+    if (battery->discharging)
+      rate = -rate;
+    if (reported_rate == 0)
+      reported_rate = rate;
+    else
+      reported_rate += ESTIMATE_SMOOTHING * (rate - reported_rate);
+  }
+}
+
+double estimate_rate()
+{
+  if (reported_rate != 0)
+    return reported_rate;
+  return history_rate();
+}
+
+double estimate_time_to_level(BatteryState *battery, int level)
+{
+  double rate = estimate_rate();
+  double target = (double)level * battery->energy_full / 1000;
+  double remaining = target - battery->energy_now;
+
+  /* unknown unless the energy is moving towards the target */
+  if (rate == 0 || (remaining < 0) != (rate < 0))
+    return -1;
+
+  return remaining / rate;
+}
+
+unsigned int estimate_interval(BatteryState *battery, int level, unsigned int minimum)
+{
+  double seconds = estimate_time_to_level(battery, level);
+
+  if (seconds < 0)
+    return 0;
+
+  seconds *= ESTIMATE_MARGIN;
+  if (seconds < minimum)
+    return minimum;
+  if (seconds > ESTIMATE_MAX_INTERVAL)
+    return ESTIMATE_MAX_INTERVAL;
+  return seconds;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include "battery.h"
+
+/* number of samples used for the discharge rate */
+#define ESTIMATE_SAMPLES 8
+
+/* smoothing factor applied to the rate reported by the battery */
+#define ESTIMATE_SMOOTHING 0.3
+
+/* wake up after this fraction of the predicted time has passed */
+#define ESTIMATE_MARGIN 0.8
+
+/* longest time to wait between checks when a rate is known (seconds) */
+#define ESTIMATE_MAX_INTERVAL 3600
+
+void estimate_reset();
+void estimate_add_sample(BatteryState *battery);
+double estimate_rate();
+/* levels are in tenths of a percent */
+double estimate_time_to_level(BatteryState *battery, int level);
+unsigned int estimate_interval(BatteryState *battery, int level, unsigned int minimum);
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "exec.h"
+#include "loop.h"
+#include "stats.h"
+
+extern char **environ;
+
+typedef struct Child {
+  pid_t pid;
+  time_t deadline;
+  bool killed;
+} Child;
+
+typedef struct Pending {
+  char command[EXEC_MAX_LENGTH];
+  bool tier;
+} Pending;
+
+static Child children[EXEC_MAX_CHILDREN];
+static Pending pending[EXEC_MAX_PENDING];
+static int pending_count = 0;
+static bool exec_direct = false;
+static unsigned int exec_timeout = 0;
+static int timer_fd = -1;
+static posix_spawnattr_t spawn_attr;
+static char argbuf[EXEC_MAX_LENGTH];
+
+static time_t now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return ts.tv_sec;
+}
+
+/* arm the timer for the earliest command deadline, commands without one have 0 */
+static void set_timer()
+{
+  struct itimerspec spec = { .it_interval = { 0, 0 }, .it_value = { 0, 0 } };
+
+  for (int i = 0; i < EXEC_MAX_CHILDREN; i++) {
+    if (children[i].pid > 0 && children[i].deadline > 0 &&
+        (spec.it_value.tv_sec == 0 || children[i].deadline < spec.it_value.tv_sec))
+      spec.it_value.tv_sec = children[i].deadline;
+  }
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static void timeout_handler(int fd, void *data)
+{
+  uint64_t expirations;
+  time_t current = now();
+
+  if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    return;
+
+  for (int i = 0; i < EXEC_MAX_CHILDREN; i++) {
+    if (children[i].pid <= 0 || children[i].deadline == 0 || children[i].deadline > current)
+      continue;
+    /* signal the whole group, so commands started by the shell stop too */
+    kill(-children[i].pid, children[i].killed ? SIGKILL : SIGTERM);
+    children[i].killed = true;
+    children[i].deadline = current + EXEC_KILL_GRACE;
+  }
+  set_timer();
+}
+
+/* a free slot for the command, message commands leave the reserved slots to tiers */
+static int free_slot(bool tier)
+{
+  int running = 0;
+  int slot = -1;
+
+  for (int i = 0; i < EXEC_MAX_CHILDREN; i++) {
+    if (children[i].pid > 0)
+      running++;
+    else if (slot < 0)
+      slot = i;
+  }
+  return running < EXEC_MAX_CHILDREN - (tier ? 0 : EXEC_RESERVED) ? slot : -1;
+}
+
+static void spawn(char *command, int slot);
+
+/* start waiting commands, in order, as far as slots allow */
+static void run_pending()
+{
+  int slot;
+  int i = 0;
+
+  while (i < pending_count) {
+    slot = free_slot(pending[i].tier);
+    if (slot < 0) {
+      i++;
+      continue;
+    }
+    spawn(pending[i].command, slot);
+    pending_count--;
+    memmove(&pending[i], &pending[i + 1], sizeof(Pending) * (pending_count - i));
+  }
+}
+
+static void child_handler(int signo)
+{
+  pid_t pid;
+
+  while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+    for (int i = 0; i < EXEC_MAX_CHILDREN; i++) {
+      if (children[i].pid == pid)
+        children[i].pid = 0;
+    }
+  }
+  run_pending();
+  if (timer_fd >= 0)
+    set_timer();
+}
+
+/* split a command into arguments, honoring single and double quotes */
+static int split_args(char *command, char *argv[])
+{
+  int argc = 0;
+  char *in = command;
+  char quote;
+  char *out = argbuf;
+
+  while (argc < EXEC_MAX_ARGS - 1) {
+    while (*in == ' ' || *in == '\t')
+      in++;
+    if (*in == '\0')
+      break;
+
+    argv[argc++] = out;
+    for (quote = '\0'; *in != '\0'; in++) {
+      if (quote == '\0' && (*in == ' ' || *in == '\t'))
+        break;
+      if (quote == '\0' && (*in == '\'' || *in == '"'))
+        quote = *in;
+      else if (*in == quote)
+        quote = '\0';
+      else
+        *out++ = *in;
+    }
+    *out++ = '\0';
+  }
+
+  argv[argc] = NULL;
+  return argc;
+}
+
+void exec_init(bool direct, unsigned int timeout)
+{
+  sigset_t mask;
+
+  /*
+   * children must not inherit the signals blocked for the event loop, and
+   * each runs in its own process group so a timeout reaches its descendants
+   */
+  sigemptyset(&mask);
+  posix_spawnattr_init(&spawn_attr);
+  posix_spawnattr_setsigmask(&spawn_attr, &mask);
+  posix_spawnattr_setpgroup(&spawn_attr, 0);
+  posix_spawnattr_setflags(&spawn_attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+  loop_signal(SIGCHLD, child_handler);
+  exec_configure(direct, timeout);
+}
+
+void exec_configure(bool direct, unsigned int timeout)
+{
+  exec_direct = direct;
+  exec_timeout = timeout;
+
+  if (timeout > 0 && timer_fd < 0) {
+    timer_fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+      err(EXIT_FAILURE, "Could not create timer");
+    loop_add(timer_fd, timeout_handler, NULL);
+  }
+}
+
+static void spawn(char *command, int slot)
+{
+  char *argv[EXEC_MAX_ARGS];
+  int result;
+
+  if (exec_direct) {
+    if (split_args(command, argv) == 0)
+      return;
+    result = posix_spawnp(&children[slot].pid, argv[0], NULL, &spawn_attr, argv, environ);
+  } else {
+    argv[0] = "sh";
+    argv[1] = "-c";
+    argv[2] = command;
+    argv[3] = NULL;
+    result = posix_spawn(&children[slot].pid, EXEC_SHELL, NULL, &spawn_attr, argv, environ);
+  }
+
+  if (result != 0) {
+    children[slot].pid = 0;
+    errno = result;
+    warn("Could not run %s", argv[0]);
+    return;
+  }
+
+  /* a reused slot must not keep the deadline of a command run before a reload */
+  stats.commands++;
+  children[slot].killed = false;
+  children[slot].deadline = exec_timeout > 0 ? now() + exec_timeout : 0;
+  if (exec_timeout > 0)
+    set_timer();
+}
+
+/* run command, or start it once a running command exits */
+void exec_command(char *command, bool tier)
+{
+  int slot;
+
+  if (strlen(command) >= EXEC_MAX_LENGTH) {
+    warnx("Command too long, skipping: %.32s...", command);
+    return;
+  }
+
+  slot = free_slot(tier);
+  if (slot >= 0) {
+    spawn(command, slot);
+    return;
+  }
+
+  if (pending_count == EXEC_MAX_PENDING) {
+    warnx("Too many commands waiting, skipping: %s", command);
+    return;
+  }
+  strcpy(pending[pending_count].command, command);
+  pending[pending_count].tier = tier;
+  pending_count++;
+}
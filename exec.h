@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef EXEC_H
+#define EXEC_H
+
+#include <stdbool.h>
+
+/* maximum number of commands running at the same time */
+#define EXEC_MAX_CHILDREN 4
+
+/* slots only tier commands may use, so hung message commands cannot block them */
+#define EXEC_RESERVED 1
+
+/* commands waiting for a running command to exit */
+#define EXEC_MAX_PENDING 4
+
+/* maximum number of arguments when running without a shell */
+#define EXEC_MAX_ARGS 64
+
+/* longest command, after expanding the message, that can be run */
+#define EXEC_MAX_LENGTH 4096
+
+/* seconds between SIGTERM and SIGKILL for commands that time out */
+#define EXEC_KILL_GRACE 5
+
+#define EXEC_SHELL "/bin/sh"
+
+void exec_init(bool direct, unsigned int timeout);
+void exec_configure(bool direct, unsigned int timeout);
+void exec_command(char *command, bool tier);
+
+#endif
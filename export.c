@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "battery.h"
+#include "estimate.h"
+#include "export.h"
+#include "state.h"
+
+static BatsignalState *shared = NULL;
+
+static bool state_path(char *path)
+{
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+  if (runtime_dir == NULL || runtime_dir[0] == '\0')
+    return false;
+  return snprintf(path, PATH_MAX, "%s/" BATSIGNAL_STATE_FILE, runtime_dir) < PATH_MAX;
+}
+
+void export_init()
+{
+  char path[PATH_MAX];
+  int fd;
+
+  if (!state_path(path))
+    return;
+
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0 || ftruncate(fd, sizeof(BatsignalState)) < 0) {
+    warn("Could not create %s", path);
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+
+  shared = mmap(NULL, sizeof(BatsignalState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    warn("Could not map %s", path);
+    shared = NULL;
+    return;
+  }
+
+  /* a file left behind by a crash mid-update may hold an odd sequence */
+  __atomic_store_n(&shared->sequence, 0, __ATOMIC_RELEASE);
+  shared->magic = BATSIGNAL_STATE_MAGIC;
+  shared->version = BATSIGNAL_STATE_VERSION;
+}
+
+void export_update(BatteryState *battery)
+{
+  double remaining;
+
+  if (shared == NULL)
+    return;
+
+  remaining = estimate_time_to_level(battery, battery->discharging ? 0 : 1000);
+
+  __atomic_fetch_add(&shared->sequence, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  shared->level = battery->level;
+  shared->level_tenths = battery->level_tenths;
+  shared->energy_now = battery->energy_now;
+  shared->energy_full = battery->energy_full;
+  shared->time_remaining = remaining < 0 ? -1 : (int64_t)remaining;
+  shared->updated = time(NULL);
+  shared->state = battery->state;
+  shared->discharging = battery->discharging;
+
+  __atomic_fetch_add(&shared->sequence, 1, __ATOMIC_RELEASE);
+}
+
+int export_query()
+{
+  char path[PATH_MAX];
+  char *states[] = { "ac", "discharging", "warning", "critical", "danger", "full" };
+  BatsignalState *mapped;
+  BatsignalState state;
+  struct stat st;
+  int fd;
+
+  if (!state_path(path))
+    errx(EXIT_FAILURE, "XDG_RUNTIME_DIR is not set");
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    err(EXIT_FAILURE, "Could not open %s", path);
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(BatsignalState))
+    errx(EXIT_FAILURE, "Invalid state in %s", path);
+  mapped = mmap(NULL, sizeof(BatsignalState), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    err(EXIT_FAILURE, "Could not map %s", path);
+
+  if (!batsignal_state_read(mapped, &state))
+    errx(EXIT_FAILURE, "Invalid state in %s", path);
+
+  printf("level=%d\n", state.level);
+  printf("level_tenths=%d\n", state.level_tenths);
+  printf("state=%s\n", state.state <= STATE_FULL ? states[state.state] : "unknown");
+  printf("discharging=%d\n", state.discharging);
+  printf("energy_now=%lld\n", (long long)state.energy_now);
+  printf("energy_full=%lld\n", (long long)state.energy_full);
+  printf("time_remaining=%lld\n", (long long)state.time_remaining);
+  printf("updated=%lld\n", (long long)state.updated);
+  printf("sequence=%u\n", state.sequence);
+
+  munmap(mapped, sizeof(BatsignalState));
+  return EXIT_SUCCESS;
+}
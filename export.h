@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "battery.h"
+
+void export_init();
+void export_update(BatteryState *battery);
+int export_query();
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "battery.h"
+#include "health.h"
+#include "notify.h"
+#include "stats.h"
+
+static int64_t now_seconds()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return now.tv_sec;
+}
+
+static void sample(Battery *bat, int64_t now)
+{
+  int64_t span;
+
+  read_cycle_count(bat);
+  bat->health_sampled = now;
+  stats.health_samples++;
+
+  /* wear is the health lost since the first sample, scaled to the trend period */
+  if (bat->health_since == 0) {
+    bat->health_since = now;
+    bat->health_start = bat->health_tenths;
+  }
+  span = now - bat->health_since;
+  if (span >= HEALTH_TREND_MIN)
+    bat->wear_tenths = (int64_t)(bat->health_start - bat->health_tenths) * HEALTH_TREND_PERIOD / span;
+}
+
+/* sample each battery's health on a slow schedule, and warn once when it drops to level */
+void health_update(BatteryState *battery, int level, char *message)
+{
+  char text[256];
+  char body[32];
+  char value[12];
+  int64_t now = now_seconds();
+  Battery *bat;
+
+  for (int i = 0; i < battery->count; i++) {
+    bat = &battery->batteries[i];
+    if (bat->dir < 0 || bat->health_tenths <= 0)
+      continue;
+    if (bat->health_sampled && now - bat->health_sampled < HEALTH_INTERVAL)
+      continue;
+
+    sample(bat, now);
+    if (level && !bat->health_low && bat->health_tenths <= level) {
+      snprintf(text, sizeof(text), "%s: %s", message, bat->name);
+      snprintf(body, sizeof(body), "Battery health: %d.%d%%", bat->health_tenths / 10, bat->health_tenths % 10);
+      snprintf(value, sizeof(value), "%d", bat->health_tenths / 10);
+      notify_text(text, NOTIFY_URGENCY_NORMAL, body, value);
+      bat->health_low = true;
+    }
+  }
+}
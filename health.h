@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include "battery.h"
+
+/* seconds between samples of the slowly changing health attributes */
+#define HEALTH_INTERVAL (6 * 60 * 60)
+
+/* shortest span a wear trend is computed over, and the period it is given for */
+#define HEALTH_TREND_MIN (24 * 60 * 60)
+#define HEALTH_TREND_PERIOD (30 * 24 * 60 * 60)
+
+void health_update(BatteryState *battery, int level, char *message);
+
+#endif
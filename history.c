@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "battery.h"
+#include "history.h"
+#include "log.h"
+
+/* worst case size of an encoded record */
+#define HISTORY_RECORD_MAX (1 + 4 * 10)
+
+typedef struct Sample {
+  int64_t time;
+  uint32_t energy_now;
+  uint32_t energy_full;
+  int32_t power;
+  uint8_t battery;
+  uint8_t status;
+} Sample;
+
+static char *history_path = NULL;
+static int history_fd = -1;
+static off_t history_size = 0;
+static BatsignalLogHeader header;
+
+/* values the next record is encoded against */
+static BatsignalLogRecord last[BATSIGNAL_LOG_MAX_BATTERIES];
+static int64_t last_time;
+
+static Sample ring[HISTORY_RING_SIZE];
+static int ring_next = 0;
+static int pending = 0;
+static uint8_t buffer[HISTORY_RING_SIZE * HISTORY_RECORD_MAX];
+
+static uint8_t status_code(char *status)
+{
+  if (strcmp(status, "Charging") == 0)
+    return BATSIGNAL_LOG_CHARGING;
+  if (strcmp(status, POWER_SUPPLY_DISCHARGING) == 0)
+    return BATSIGNAL_LOG_DISCHARGING;
+  if (strcmp(status, "Not charging") == 0)
+    return BATSIGNAL_LOG_NOT_CHARGING;
+  if (strcmp(status, POWER_SUPPLY_FULL) == 0)
+    return BATSIGNAL_LOG_FULL;
+  return BATSIGNAL_LOG_UNKNOWN;
+}
+
+static uint8_t *put_varint(uint8_t *p, int64_t value)
+{
+  uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+  while (zigzag >= 0x80) {
+    *p++ = zigzag | 0x80;
+    zigzag >>= 7;
+  }
+  *p++ = zigzag;
+  return p;
+}
+
+static bool create_log()
+{
+  header.start = time(NULL);
+  last_time = header.start;
+  memset(last, 0, sizeof(last));
+
+  history_fd = open(history_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (history_fd < 0 || write(history_fd, &header, sizeof(header)) != sizeof(header)) {
+    warn("Could not create %s", history_path);
+    if (history_fd >= 0)
+      close(history_fd);
+    history_fd = -1;
+    return false;
+  }
+  history_size = sizeof(header);
+  return true;
+}
+
+static void rotate_log()
+{
+  char rotated[PATH_MAX];
+
+  if (history_fd >= 0)
+    close(history_fd);
+  history_fd = -1;
+
+  if (snprintf(rotated, sizeof(rotated), "%s.1", history_path) >= (int)sizeof(rotated) ||
+      rename(history_path, rotated) < 0)
+    warn("Could not rotate %s", history_path);
+  create_log();
+}
+
+/* continue an existing log written for the same batteries */
+static bool resume_log()
+{
+  BatsignalLogReader reader;
+  BatsignalLogRecord record;
+  struct stat st;
+  void *data;
+  bool valid;
+
+  history_fd = open(history_path, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (history_fd < 0 || fstat(history_fd, &st) < 0 || st.st_size < (off_t)sizeof(header))
+    return false;
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history_fd, 0);
+  if (data == MAP_FAILED)
+    return false;
+
+  valid = batsignal_log_open(&reader, data, st.st_size) &&
+    memcmp(((BatsignalLogHeader *)data)->names, header.names, sizeof(header.names)) == 0 &&
+    reader.battery_count == header.battery_count;
+  if (valid) {
+    header.start = ((BatsignalLogHeader *)data)->start;
+    while (batsignal_log_next(&reader, &record));
+    memcpy(last, reader.last, sizeof(last));
+    last_time = reader.time;
+    history_size = reader.next - (uint8_t *)data;
+  }
+  munmap(data, st.st_size);
+
+  /* drop a record cut short by a crash */
+  if (valid && history_size < st.st_size && ftruncate(history_fd, history_size) < 0)
+    valid = false;
+  return valid;
+}
+
+void history_init(char *path, BatteryState *battery)
+{
+  history_flush();
+  if (history_fd >= 0)
+    close(history_fd);
+  history_path = path;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = BATSIGNAL_LOG_MAGIC;
+  header.version = BATSIGNAL_LOG_VERSION;
+  header.battery_count = battery->count < BATSIGNAL_LOG_MAX_BATTERIES ?
+    battery->count : BATSIGNAL_LOG_MAX_BATTERIES;
+  for (unsigned int i = 0; i < header.battery_count; i++)
+    strncpy(header.names[i], battery->names[i], BATSIGNAL_LOG_NAME_LENGTH - 1);
+
+  if (access(path, F_OK) < 0)
+    create_log();
+  else if (!resume_log())
+    rotate_log();
+}
+
+void history_flush()
+{
+  uint8_t *p = buffer;
+  Sample *sample;
+  BatsignalLogRecord *prev;
+  int index;
+  ssize_t len;
+
+  if (history_fd < 0 || pending == 0)
+    return;
+
+  if (history_size + pending * HISTORY_RECORD_MAX > HISTORY_MAX_SIZE) {
+    rotate_log();
+    if (history_fd < 0)
+      return;
+  }
+
+  for (int i = 0; i < pending; i++) {
+    index = (ring_next - pending + i + HISTORY_RING_SIZE) % HISTORY_RING_SIZE;
+    sample = &ring[index];
+    prev = &last[sample->battery];
+
+    *p++ = sample->battery | sample->status << 4;
+    p = put_varint(p, sample->time - last_time);
+    p = put_varint(p, sample->energy_now - prev->energy_now);
+    p = put_varint(p, sample->energy_full - prev->energy_full);
+    p = put_varint(p, sample->power - prev->power);
+
+    last_time = sample->time;
+    prev->energy_now = sample->energy_now;
+    prev->energy_full = sample->energy_full;
+    prev->power = sample->power;
+  }
+  pending = 0;
+
+  /* a single write per batch, rolled back if it was cut short */
+  len = write(history_fd, buffer, p - buffer);
+  if (len == p - buffer) {
+    history_size += len;
+  } else {
+    warn("Could not write %s", history_path);
+    if (len > 0 && ftruncate(history_fd, history_size) < 0) { /* Continue... */ }
+    close(history_fd);
+    history_fd = -1;
+  }
+}
+
+void history_add(BatteryState *battery)
+{
+  int64_t now = time(NULL);
+  Battery *bat;
+  Sample *sample;
+
+  if (history_fd < 0)
+    return;
+
+  for (unsigned int i = 0; i < header.battery_count; i++) {
+    bat = &battery->batteries[i];
+    if (bat->dir < 0)
+      continue;
+
+    if (pending == HISTORY_RING_SIZE)
+      history_flush();
+
+    sample = &ring[ring_next];
+    sample->time = now;
+    sample->battery = i;
+    sample->status = status_code(bat->status_text);
+    sample->energy_now = bat->energy_now;
+    sample->energy_full = bat->energy_full;
+    sample->power = sample->status == BATSIGNAL_LOG_DISCHARGING ?
+      -(int32_t)bat->energy_rate : (int32_t)bat->energy_rate;
+    ring_next = (ring_next + 1) % HISTORY_RING_SIZE;
+    pending++;
+  }
+
+  /* keep batching, but do not hold samples back indefinitely */
+  if (pending > 0) {
+    sample = &ring[(ring_next - pending + HISTORY_RING_SIZE) % HISTORY_RING_SIZE];
+    if (now - sample->time >= HISTORY_FLUSH_INTERVAL)
+      history_flush();
+  }
+}
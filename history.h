@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "battery.h"
+
+/* samples kept in memory before they are written out together */
+#define HISTORY_RING_SIZE 256
+
+/* longest time (seconds) a sample waits in memory */
+#define HISTORY_FLUSH_INTERVAL 3600
+
+/* size at which the log is rotated to FILE.1 */
+#define HISTORY_MAX_SIZE (1024 * 1024)
+
+void history_init(char *path, BatteryState *battery);
+void history_add(BatteryState *battery);
+void history_flush();
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Battery history log written by batsignal with the -l option.
+ *
+ * The file starts with a BatsignalLogHeader followed by variable length
+ * records, one per battery sample. Each record is a byte holding the
+ * battery index and status, followed by the zigzag varint encoded change
+ * in time (seconds, from the previous record), energy_now, energy_full and
+ * power (from the previous record of the same battery). Readers can map the
+ * file and walk it with batsignal_log_open() and batsignal_log_next().
+ */
+
+#ifndef BATSIGNAL_LOG_H
+#define BATSIGNAL_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BATSIGNAL_LOG_MAGIC 0x474f4c42 /* "BLOG" */
+#define BATSIGNAL_LOG_VERSION 1
+#define BATSIGNAL_LOG_MAX_BATTERIES 8
+#define BATSIGNAL_LOG_NAME_LENGTH 16
+
+/* battery status stored in the upper bits of the record's first byte */
+#define BATSIGNAL_LOG_UNKNOWN 0
+#define BATSIGNAL_LOG_CHARGING 1
+#define BATSIGNAL_LOG_DISCHARGING 2
+#define BATSIGNAL_LOG_NOT_CHARGING 3
+#define BATSIGNAL_LOG_FULL 4
+
+typedef struct BatsignalLogHeader {
+  uint32_t magic;
+  uint32_t version;
+
+  /* wall clock time the time deltas start from */
+  int64_t start;
+
+  uint32_t battery_count;
+  uint32_t padding;
+  char names[BATSIGNAL_LOG_MAX_BATTERIES][BATSIGNAL_LOG_NAME_LENGTH];
+} BatsignalLogHeader;
+
+typedef struct BatsignalLogRecord {
+  /* wall clock time of the sample */
+  int64_t time;
+
+  uint8_t battery;
+  uint8_t status;
+
+  /* uWh (or uAh/percent if unknown) and uW, power is negative when discharging */
+  int64_t energy_now;
+  int64_t energy_full;
+  int64_t power;
+} BatsignalLogRecord;
+
+typedef struct BatsignalLogReader {
+  const uint8_t *next;
+  const uint8_t *end;
+  BatsignalLogRecord last[BATSIGNAL_LOG_MAX_BATTERIES];
+  int64_t time;
+  uint32_t battery_count;
+} BatsignalLogReader;
+
+static inline bool batsignal_log_varint(const uint8_t **p, const uint8_t *end, int64_t *value)
+{
+  uint64_t result = 0;
+
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    result |= (uint64_t)(**p & 0x7f) << shift;
+    if ((*(*p)++ & 0x80) == 0) {
+      *value = (int64_t)(result >> 1) ^ -(int64_t)(result & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* start reading a mapped log, false if the header is invalid */
+static inline bool batsignal_log_open(BatsignalLogReader *reader, const void *data, size_t size)
+{
+  const BatsignalLogHeader *header = data;
+
+  if (size < sizeof(BatsignalLogHeader) || header->magic != BATSIGNAL_LOG_MAGIC ||
+      header->version != BATSIGNAL_LOG_VERSION || header->battery_count > BATSIGNAL_LOG_MAX_BATTERIES)
+    return false;
+
+  memset(reader, 0, sizeof(BatsignalLogReader));
+  reader->next = (const uint8_t *)data + sizeof(BatsignalLogHeader);
+  reader->end = (const uint8_t *)data + size;
+  reader->time = header->start;
+  reader->battery_count = header->battery_count;
+  return true;
+}
+
+/* decode the next record, false at the end of the log or a truncated record */
+static inline bool batsignal_log_next(BatsignalLogReader *reader, BatsignalLogRecord *record)
+{
+  const uint8_t *p = reader->next;
+  BatsignalLogRecord *last;
+  int64_t delta[4];
+  uint8_t battery;
+
+  if (p >= reader->end)
+    return false;
+  battery = *p & 0x0f;
+  if (battery >= reader->battery_count)
+    return false;
+  last = &reader->last[battery];
+  last->status = *p++ >> 4;
+
+  for (int i = 0; i < 4; i++) {
+    if (!batsignal_log_varint(&p, reader->end, &delta[i]))
+      return false;
+  }
+
+  reader->time += delta[0];
+  last->time = reader->time;
+  last->battery = battery;
+  last->energy_now += delta[1];
+  last->energy_full += delta[2];
+  last->power += delta[3];
+  reader->next = p;
+
+  *record = *last;
+  return true;
+}
+
+#endif
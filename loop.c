@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "loop.h"
+#include "stats.h"
+
+typedef struct LoopSource {
+  int fd;
+  LoopHandler handler;
+  void *data;
+} LoopSource;
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int signal_fd = -1;
+static sigset_t signal_mask;
+static LoopSignalHandler signal_handlers[NSIG];
+static LoopSource sources[LOOP_MAX_SOURCES];
+static bool check_requested = false;
+static long long align_ms = 0;
+
+/* boundaries tried, coarsest first, when coalescing a deadline */
+static const long long boundaries_ms[] = { 60000, 10000, 1000, 250 };
+
+static void exit_handler(int signo)
+{
+  exit(EXIT_SUCCESS);
+}
+
+static void check_handler(int signo)
+{
+  loop_request_check();
+}
+
+static void timer_handler(int fd, void *data)
+{
+  uint64_t expirations;
+
+  stats.wakeups[STATS_TIMER]++;
+  if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+    loop_request_check();
+}
+
+static void signalfd_handler(int fd, void *data)
+{
+  struct signalfd_siginfo info;
+
+  while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+    stats.wakeups[STATS_SIGNAL]++;
+    if (info.ssi_signo < NSIG && signal_handlers[info.ssi_signo])
+      signal_handlers[info.ssi_signo](info.ssi_signo);
+  }
+}
+
+void loop_init()
+{
+  for (int i = 0; i < LOOP_MAX_SOURCES; i++)
+    sources[i].fd = -1;
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0)
+    err(EXIT_FAILURE, "Could not create event loop");
+
+  /* CLOCK_BOOTTIME keeps counting while the system is suspended */
+  timer_fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd < 0)
+    err(EXIT_FAILURE, "Could not create timer");
+  loop_add(timer_fd, timer_handler, NULL);
+
+  sigemptyset(&signal_mask);
+  signal_fd = signalfd(-1, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd < 0)
+    err(EXIT_FAILURE, "Could not create signal handler");
+  loop_add(signal_fd, signalfd_handler, NULL);
+
+  loop_signal(SIGUSR1, check_handler);
+  loop_signal(SIGTERM, exit_handler);
+  loop_signal(SIGINT, exit_handler);
+}
+
+void loop_add(int fd, LoopHandler handler, void *data)
+{
+  struct epoll_event event = { .events = EPOLLIN };
+  int i;
+
+  for (i = 0; i < LOOP_MAX_SOURCES && sources[i].fd >= 0; i++);
+  if (i == LOOP_MAX_SOURCES)
+    errx(EXIT_FAILURE, "Too many event sources");
+
+  sources[i].fd = fd;
+  sources[i].handler = handler;
+  sources[i].data = data;
+  event.data.ptr = &sources[i];
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    err(EXIT_FAILURE, "Could not add event source");
+}
+
+void loop_remove(int fd)
+{
+  for (int i = 0; i < LOOP_MAX_SOURCES; i++) {
+    if (sources[i].fd == fd) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+      sources[i].fd = -1;
+    }
+  }
+}
+
+void loop_signal(int signo, LoopSignalHandler handler)
+{
+  signal_handlers[signo] = handler;
+  sigaddset(&signal_mask, signo);
+  sigprocmask(SIG_BLOCK, &signal_mask, NULL);
+  if (signalfd(signal_fd, &signal_mask, 0) < 0)
+    err(EXIT_FAILURE, "Could not update signal handler");
+}
+
+static long long to_ms(struct timespec *ts)
+{
+  return ts->tv_sec * 1000LL + ts->tv_nsec / 1000000;
+}
+
+static long long round_up(long long value, long long step)
+{
+  return (value + step - 1) / step * step;
+}
+
+/* pick the coarsest boundary that falls within [earliest, latest] */
+static long long coalesce(long long earliest, long long latest)
+{
+  long long deadline;
+
+  if (align_ms > 0 && (deadline = round_up(earliest, align_ms)) <= latest)
+    return deadline;
+  for (unsigned int i = 0; i < sizeof(boundaries_ms) / sizeof(boundaries_ms[0]); i++) {
+    if ((deadline = round_up(earliest, boundaries_ms[i])) <= latest)
+      return deadline;
+  }
+  return earliest;
+}
+
+void loop_set_alignment(unsigned int seconds)
+{
+  align_ms = seconds * 1000LL;
+}
+
+void loop_set_timer(unsigned int seconds, unsigned int slack)
+{
+  struct itimerspec spec = { .it_interval = { 0, 0 } };
+  struct timespec monotonic;
+  long long now;
+  long long deadline;
+
+  /* arm an absolute deadline so time spent suspended is counted */
+  if (seconds > 0) {
+    /* boundaries are shared with other timers on the monotonic clock */
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_BOOTTIME, &spec.it_value);
+    now = to_ms(&monotonic);
+    deadline = coalesce(now + seconds * 1000LL, now + (seconds + slack) * 1000LL);
+    deadline += to_ms(&spec.it_value) - now;
+    spec.it_value.tv_sec = deadline / 1000;
+    spec.it_value.tv_nsec = deadline % 1000 * 1000000;
+  } else {
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 0;
+  }
+
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+    err(EXIT_FAILURE, "Could not set timer");
+}
+
+void loop_request_check()
+{
+  check_requested = true;
+}
+
+void loop_wait()
+{
+  struct epoll_event events[LOOP_MAX_EVENTS];
+  LoopSource *source;
+  int count;
+
+  check_requested = false;
+  while (!check_requested) {
+    count = epoll_wait(epoll_fd, events, LOOP_MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      err(EXIT_FAILURE, "Failed to wait for events");
+    }
+
+    for (int i = 0; i < count; i++) {
+      source = events[i].data.ptr;
+      if (source->fd >= 0)
+        source->handler(source->fd, source->data);
+    }
+  }
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef LOOP_H
+#define LOOP_H
+
+#define LOOP_MAX_SOURCES 16
+#define LOOP_MAX_EVENTS 8
+
+typedef void (*LoopHandler)(int fd, void *data);
+typedef void (*LoopSignalHandler)(int signo);
+
+void loop_init();
+void loop_add(int fd, LoopHandler handler, void *data);
+void loop_remove(int fd);
+void loop_signal(int signo, LoopSignalHandler handler);
+void loop_set_alignment(unsigned int seconds);
+void loop_set_timer(unsigned int seconds, unsigned int slack);
+void loop_request_check();
+void loop_wait();
+
+#endif
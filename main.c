@@ -18,15 +18,27 @@
 #define _DEFAULT_SOURCE
 #include <err.h>
 #include <errno.h>
-#include <signal.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "battery.h"
+#include "estimate.h"
+#include "control.h"
+#include "debounce.h"
+#include "exec.h"
+#include "export.h"
+#include "health.h"
+#include "history.h"
+#include "loop.h"
 #include "main.h"
 #include "notify.h"
 #include "options.h"
+#include "reload.h"
+#include "resume.h"
+#include "stats.h"
+#include "uevent.h"
 
 void print_version()
 {
@@ -42,8 +54,9 @@ Sends battery level notifications.\n\
 Options:\n\
     -h             print this help message\n\
     -v             print program version information\n\
+    -q             print the state published by the running daemon\n\
     -b             run as background daemon\n\
-    -o             check battery once and exit\n\
+    -o             check battery once, print statistics and exit\n\
     -i             ignore missing battery errors\n\
     -e             cause notifications to expire\n\
     -N             disable desktop notifications\n\
@@ -55,47 +68,235 @@ Options:\n\
                    (default: 2)\n\
     -f LEVEL       full battery LEVEL\n\
                    (default: disabled)\n\
+                   LEVELs are percent (ex: 2.5), energy (ex: 4Wh) or\n\
+                   estimated minutes remaining (ex: 10min)\n\
+    -t TIER        add a discharge tier given as\n\
+                   LEVEL:HYSTERESIS:URGENCY:MESSAGE:COMMAND\n\
     -p             show message when battery begins charging/discharging\n\
     -W MESSAGE     show MESSAGE when battery is at warning level\n\
     -C MESSAGE     show MESSAGE when battery is at critical level\n\
     -D COMMAND     run COMMAND when battery is at danger level\n\
     -F MESSAGE     show MESSAGE when battery is full\n\
+    -k LEVEL       warn when any single battery discharges to LEVEL percent\n\
+                   (default: disabled)\n\
+    -K MESSAGE     show MESSAGE, followed by the battery name, when a single\n\
+                   battery is at its warning level\n\
+    -H PERCENT     warn once when a battery's full capacity drops to PERCENT\n\
+                   of its design capacity (default: disabled)\n\
+    -L MESSAGE     show MESSAGE, followed by the battery name, when a\n\
+                   battery's health is low\n\
     -P MESSAGE     battery charging MESSAGE\n\
     -U MESSAGE     battery discharging MESSAGE\n\
     -M COMMAND     send each message using COMMAND\n\
+    -l FILE        append battery samples to the history log FILE\n\
+    -x             run COMMANDs directly instead of using a shell\n\
+    -T SECONDS     stop COMMANDs that run longer than SECONDS\n\
+                   (default: 0 - no limit)\n\
     -n NAME        use battery NAME - multiple batteries separated by commas\n\
-                   (default: BAT0)\n\
+                   (default: all system batteries)\n\
+    -G PATTERN     only use batteries matching a glob PATTERN when none are\n\
+                   named with -n - multiple patterns separated by commas\n\
+    -X PATTERN     ignore batteries matching a glob PATTERN\n\
     -m SECONDS     minimum number of SECONDS to wait between battery checks\n\
                    0 SECONDS disables polling and waits for USR1 signal\n\
                    Prefixing with a + will always check at SECONDS interval\n\
                    (default: 60)\n\
+    -s PERCENT     allow checks to be delayed by PERCENT of the interval so\n\
+                   they coincide with other wakeups (default: 0)\n\
+    -A SECONDS     align delayed checks to multiples of SECONDS\n\
+                   (default: 0 - disabled)\n\
+    -u SECONDS     check battery when the kernel reports a power supply change\n\
+                   while charging, only poll every SECONDS (0 disables polling)\n\
+    -S SECONDS     act on charging/discharging changes only after they last\n\
+                   SECONDS (default: 0 - immediately)\n\
     -a NAME        app NAME used in desktop notifications\n\
                    (default: %s)\n\
     -I ICON        display specified ICON in notifications\n\
+    -R             reload the config file when it changes, as on HUP signal\n\
 ", PROGNAME, PROGNAME);
 }
 
 void cleanup()
 {
-  if (notify_is_initted()) {
-    notify_uninit();
+  history_flush();
+  notification_uninit();
+}
+
+/* level is in tenths of a percent */
+unsigned int check_interval(Config *config, BatteryState *battery, int level, unsigned int fallback)
+{
+  unsigned int interval;
+
+  if (config->fixed)
+    return config->multiplier;
+
+  /* wake up shortly before the level is expected to be reached */
+  interval = estimate_interval(battery, level, config->multiplier);
+  return interval ? interval : fallback;
+}
+
+/* allow less slack as the level approaches the critical and danger levels */
+unsigned int timer_slack(Config *config, BatteryState *battery, unsigned int duration, int warning, int low)
+{
+  unsigned int slack = duration * config->timer_slack / 100;
+
+  if (slack < (unsigned int)config->timer_align)
+    slack = config->timer_align;
+
+  if (!battery->discharging)
+    return slack;
+  if (battery->level_tenths <= low)
+    return 0;
+  if (warning && battery->level_tenths <= warning)
+    return slack * (battery->level_tenths - low) / (warning - low);
+  return slack;
+}
+
+/* warn about single batteries running low, returns seconds until the next one might */
+unsigned int check_packs(Config *config, BatteryState *battery)
+{
+  char message[256];
+  BatteryState pack = *battery;
+  unsigned int wait = 0;
+  uint64_t seconds;
+  uint64_t target;
+  Battery *bat;
+
+  for (int i = 0; i < battery->count; i++) {
+    bat = &battery->batteries[i];
+    if (bat->dir < 0 || !battery->discharging) {
+      bat->low = false;
+      continue;
+    }
+
+    /* the combined status is debounced, so a brief flap neither warns nor rearms */
+    if (!bat->discharging)
+      continue;
+
+    if (bat->level_tenths <= config->pack.value) {
+      if (!bat->low) {
+        snprintf(message, sizeof(message), "%s: %s", config->packmsg, bat->name);
+        pack.level = (bat->level_tenths + 5) / 10;
+        notify(message, NOTIFY_URGENCY_NORMAL, pack);
+      }
+      bat->low = true;
+    } else if (bat->level_tenths > config->pack.value + TIER_HYSTERESIS) {
+      bat->low = false;
+    }
+
+    /* time for this battery alone to reach the level at its current rate */
+    target = (uint64_t)bat->energy_full * config->pack.value / 1000;
+    if (!bat->low && bat->energy_rate && bat->energy_now > target) {
+      seconds = (bat->energy_now - target) * 3600 / bat->energy_rate;
+      if (seconds < UINT_MAX && (wait == 0 || seconds < wait))
+        wait = seconds;
+    }
+  }
+  return wait;
+}
+
+/* the startup configuration is kept, as options used only at startup point into it */
+static Arena startup_arena;
+static Arena reload_arena;
+
+/* open the batteries given with -n, or all batteries found */
+bool open_batteries(Config *config, BatteryState *battery)
+{
+  int bat_index;
+
+  battery->arena.blocks = NULL;
+  battery->hotplug = config->battery_count == 0;
+  set_battery_filter(config->include, config->include_count, config->exclude, config->exclude_count);
+  if (config->battery_count > 0) {
+    battery->names = config->battery_names;
+    battery->count = config->battery_count;
+    bat_index = validate_batteries(&battery->names, battery->count, &battery->batteries, &battery->arena);
+    if (config->battery_required && bat_index >= 0) {
+      warnx("Battery %s not found", battery->names[bat_index]);
+      return false;
+    }
+  } else {
+    battery->count = find_batteries(&battery->names, &battery->batteries, &battery->arena);
+  }
+
+  if (battery->count < 1) {
+    warnx("No batteries found");
+    return false;
   }
+  return true;
 }
 
-void signal_handler()
+void print_batteries(BatteryState *battery)
 {
-  exit(EXIT_SUCCESS);
+  printf("Using batteries:   %s", battery->count ? battery->names[0] : "none");
+  for (int i = 1; i < battery->count; i++)
+    printf(", %s", battery->names[i]);
+  printf("\n");
+  fflush(stdout);
+}
+
+/* swap in a new configuration, keeping the battery state and active levels */
+void reload(Config *config, BatteryState *battery)
+{
+  Config next = *config;
+  BatteryState opened = *battery;
+  Arena arena = { NULL };
+  bool rescan;
+
+  if (!reload_config(&next, &rescan, &arena)) {
+    arena_free(&arena);
+    return;
+  }
+
+  if (rescan) {
+    if (!open_batteries(&next, &opened)) {
+      close_batteries(opened.batteries, opened.count);
+      arena_free(&opened.arena);
+      arena_free(&arena);
+      set_battery_filter(config->include, config->include_count, config->exclude, config->exclude_count);
+      warnx("Not reloading, keeping the current batteries");
+      return;
+    }
+    close_batteries(battery->batteries, battery->count);
+    arena_free(&battery->arena);
+    battery->arena = opened.arena;
+    battery->batteries = opened.batteries;
+    battery->names = opened.names;
+    battery->count = opened.count;
+    battery->hotplug = opened.hotplug;
+    battery->generation++;
+  }
+
+  /* release the previous generation of the configuration */
+  arena_free(&reload_arena);
+  reload_arena = arena;
+  *config = next;
+
+  /* the patterns of the released configuration are gone, even if unchanged */
+  set_battery_filter(config->include, config->include_count, config->exclude, config->exclude_count);
+  set_message_command(config->msgcmd);
+  exec_configure(config->exec_direct, config->command_timeout);
+  loop_set_alignment(config->timer_align);
+  debounce_init(config->settle, battery);
+  stats.reloads++;
+  printf("Reloaded configuration\n");
+  fflush(stdout);
 }
 
 int main(int argc, char *argv[])
 {
   unsigned int duration;
+  unsigned int pack_wait;
+  int next_level;
+  int full;
+  int tier;
+  int active_tier = -1;
+  TierTable tiers;
   bool previous_discharging_status;
-  sigset_t sigs;
-  struct timespec timeout = { .tv_sec = 0 };
-  int bat_index;
-  BatteryState battery;
+  unsigned int generation;
+  BatteryState battery = { .batteries = NULL };
   char *config_file = NULL;
+  char *power_supply;
   int conf_argc = 0;
   char **conf_argv;
 
@@ -107,39 +308,61 @@ int main(int argc, char *argv[])
     .show_charging_msg = false,
     .help = false,
     .version = false,
+    .query = false,
+    .reload = false,
+    .invalid_option = 0,
+    .missing_argument = false,
     .battery_names = NULL,
     .battery_count = 0,
+    .include = NULL,
+    .include_count = 0,
+    .exclude = NULL,
+    .exclude_count = 0,
     .multiplier = 60,
     .fixed = false,
-    .warning = 15,
-    .critical = 5,
-    .danger = 2,
-    .full = 0,
+    .timer_slack = 0,
+    .timer_align = 0,
+    .uevent = false,
+    .uevent_fallback = 0,
+    .settle = 0,
+    .warning = { THRESHOLD_PERCENT, 150 },
+    .critical = { THRESHOLD_PERCENT, 50 },
+    .danger = { THRESHOLD_PERCENT, 20 },
+    .full = { THRESHOLD_PERCENT, 0 },
+    .pack = { THRESHOLD_PERCENT, 0 },
+    .health = { THRESHOLD_PERCENT, 0 },
+    .tier_count = 0,
     .warningmsg = "Battery is low",
     .criticalmsg = "Battery is critically low",
     .fullmsg = "Battery is full",
+    .packmsg = "Battery pack is low",
+    .healthmsg = "Battery health is low",
     .chargingmsg = "Battery is charging",
     .dischargingmsg = "Battery is discharging",
     .dangercmd = "",
     .msgcmd = "",
+    .history_file = NULL,
+    .exec_direct = false,
+    .command_timeout = 0,
     .appname = PROGNAME,
     .icon = NULL,
     .notification_expires = NOTIFY_EXPIRES_NEVER
   };
 
-  sigemptyset(&sigs);
-  sigaddset(&sigs, SIGUSR1);
   atexit(cleanup);
-  signal(SIGTERM, signal_handler);
-  signal(SIGINT, signal_handler);
-  sigprocmask(SIG_BLOCK, &sigs, NULL);
+  loop_init();
+  stats_init();
+  resume_init();
+  reload_init(&config, argc, argv);
 
-  config_file = find_config_file();
+  config_file = find_config_file(&startup_arena);
   if (config_file) {
-    conf_argv = read_config_file(config_file, &conf_argc, NULL);
-    parse_args(conf_argc, conf_argv, &config);
+    conf_argv = read_config_file(config_file, &conf_argc, NULL, &startup_arena);
+    if (conf_argv == NULL)
+      err(EXIT_FAILURE, "Could not read %s", config_file);
+    parse_args(conf_argc, conf_argv, &config, &startup_arena);
   }
-  parse_args(argc, argv, &config);
+  parse_args(argc, argv, &config, &startup_arena);
 
   if (config.help) {
     print_help();
@@ -147,66 +370,71 @@ int main(int argc, char *argv[])
   } else if (config.version) {
     print_version();
     return EXIT_SUCCESS;
+  } else if (config.query) {
+    return export_query();
   }
 
   validate_options(&config);
+  loop_set_alignment(config.timer_align);
+  power_supply = getenv(PROGUPPER "_POWER_SUPPLY");
+  if (power_supply && power_supply[0] != '\0')
+    set_power_supply_path(power_supply);
   if (config_file)
     printf("Using config file: %s\n", config_file);
 
   if (config.show_notifications)
     notification_init(config.appname, config.icon, config.notification_expires);
   set_message_command(config.msgcmd);
+  exec_init(config.exec_direct, config.command_timeout);
 
-  if (config.battery_count > 0) {
-    bat_index = validate_batteries(config.battery_names, config.battery_count);
-    if (config.battery_required && bat_index >= 0)
-      err(EXIT_FAILURE, "Battery %s not found", config.battery_names[bat_index]);
-  } else {
-    config.battery_count = find_batteries(&config.battery_names);
-  }
-  if (config.battery_count < 1)
-    errx(EXIT_FAILURE, "No batteries found");
+  if (!open_batteries(&config, &battery))
+    exit(EXIT_FAILURE);
 
-  printf("Using batteries:   %s", config.battery_names[0]);
-  for (int i = 1; i < config.battery_count; i++)
-    printf(", %s", config.battery_names[i]);
-  printf("\n");
+  print_batteries(&battery);
 
   if (config.daemonize && daemon(1, 1) < 0) {
     err(EXIT_FAILURE, "Failed to daemonize");
   }
 
-  battery.names = config.battery_names;
-  battery.count = config.battery_count;
+  if (config.uevent)
+    uevent_init(&battery);
+  /* a single check must not replace the state published by a running daemon */
+  if (!config.run_once) {
+    export_init();
+    control_init(&config, &battery);
+  }
+  if (config.reload)
+    reload_watch(config_file);
+
+  if (config.history_file)
+    history_init(config.history_file, &battery);
+  stats_loop_begin();
   update_battery_state(&battery, config.battery_required);
+  debounce_init(config.settle, &battery);
+  previous_discharging_status = battery.discharging;
+  generation = battery.generation;
 
   for(;;) {
-    previous_discharging_status = battery.discharging;
-    update_battery_state(&battery, config.battery_required);
+    estimate_add_sample(&battery);
     duration = config.multiplier;
 
-    if (battery.discharging) { /* discharging */
-      if (config.danger && battery.level <= config.danger) {
-        if (battery.state != STATE_DANGER) {
-          battery.state = STATE_DANGER;
-          if (config.dangercmd[0] != '\0')
-            if (system(config.dangercmd) == -1) { /* Ignore command errors... */ }
-        }
-
-      } else if (config.critical && battery.level <= config.critical) {
-        if (battery.state != STATE_CRITICAL) {
-          battery.state = STATE_CRITICAL;
-          notify(config.criticalmsg, NOTIFY_URGENCY_CRITICAL, battery);
-        }
+    /* levels in tenths of a percent for the current capacity and rate */
+    tier_build(&tiers, &config, &battery);
+    full = threshold_level(&config.full, &battery);
 
-      } else if (config.warning && battery.level <= config.warning) {
-        if (!config.fixed)
-          duration = (battery.level - config.critical) * config.multiplier;
+    if (battery.discharging) { /* discharging */
+      tier = tier_find(&tiers, battery.level_tenths, active_tier);
 
-        if (battery.state != STATE_WARNING) {
-          battery.state = STATE_WARNING;
-          notify(config.warningmsg, NOTIFY_URGENCY_NORMAL, battery);
+      if (tier >= 0) {
+        /* act only when reaching a more severe tier */
+        if (tier > tier_index(&tiers, active_tier)) {
+          if (tiers.tiers[tier]->message[0] != '\0')
+            notify(tiers.tiers[tier]->message, tiers.tiers[tier]->urgency, battery);
+          if (tiers.tiers[tier]->command[0] != '\0')
+            exec_command(tiers.tiers[tier]->command, true);
         }
+        active_tier = tiers.tiers[tier]->id;
+        battery.state = tiers.tiers[tier]->state;
 
       } else {
         if (config.show_charging_msg && battery.discharging != previous_discharging_status) {
@@ -214,13 +442,19 @@ int main(int argc, char *argv[])
         } else if (battery.state == STATE_FULL) {
           close_notification();
         }
+        active_tier = -1;
         battery.state = STATE_DISCHARGING;
-        if (!config.fixed)
-          duration = (battery.level - config.warning) * config.multiplier;
       }
 
+      /* wake up for the next tier below the current one */
+      next_level = tier_next_level(&tiers, tier);
+      if (next_level || tier < 0)
+        duration = check_interval(&config, &battery, next_level,
+            (battery.level_tenths - next_level) * config.multiplier / 10);
+
     } else { /* charging */
-      if ((config.full && battery.state != STATE_FULL) && (battery.level >= config.full || battery.full)) {
+      active_tier = -1;
+      if ((full && battery.state != STATE_FULL) && (battery.level_tenths >= full || battery.full)) {
         battery.state = STATE_FULL;
         notify(config.fullmsg, NOTIFY_URGENCY_NORMAL, battery);
 
@@ -232,17 +466,51 @@ int main(int argc, char *argv[])
         battery.state = STATE_AC;
         close_notification();
       }
+
+      if (full && battery.state != STATE_FULL)
+        duration = check_interval(&config, &battery, full, config.multiplier);
+      else if (config.uevent) /* kernel events report charging changes */
+        duration = config.uevent_fallback;
     }
 
-    if (config.multiplier == 0) {
-      sigwaitinfo(&sigs, NULL);
-    } else {
-      timeout.tv_sec = duration;
-      sigtimedwait(&sigs, NULL, &timeout);
+    if (config.pack.value) {
+      pack_wait = check_packs(&config, &battery);
+      if (!config.fixed && pack_wait && pack_wait < duration)
+        duration = pack_wait > (unsigned int)config.multiplier ? pack_wait : (unsigned int)config.multiplier;
     }
 
+    health_update(&battery, config.health.value, config.healthmsg);
+    export_update(&battery);
+    history_add(&battery);
+    control_update(&battery);
+    stats_loop_end();
+
+    /* run once mode exits after a single battery check */
     if (config.run_once) break;
+
+    duration = debounce_interval(resume_interval(&battery, duration));
+    loop_set_timer(config.multiplier || debounce_pending() ? duration : 0, timer_slack(&config, &battery, duration,
+        tiers.count ? tiers.levels[0] : 0, tier_critical_level(&tiers)));
+    loop_wait();
+
+    stats_loop_begin();
+    if (reload_requested())
+      reload(&config, &battery);
+
+    /* batteries were added or removed */
+    if (battery.generation != generation) {
+      generation = battery.generation;
+      print_batteries(&battery);
+      estimate_reset();
+      if (config.history_file)
+        history_init(config.history_file, &battery);
+    }
+    previous_discharging_status = battery.discharging;
+    update_battery_state(&battery, config.battery_required);
+    debounce_update(&battery);
   }
 
+  stats_print(stdout);
+
   return EXIT_SUCCESS;
 }
@@ -6,22 +6,61 @@
 #include <err.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "battery.h"
+#include "exec.h"
 #include "notify.h"
+#include "stats.h"
 
+static bool notifications_enabled = false;
+#ifndef NOTIFY_SDBUS
 static NotifyNotification *notification = NULL;
+static char *notification_appname = NULL;
 static char *notification_icon = NULL;
+static int notification_expires = NOTIFY_EXPIRES_NEVER;
+
+/*
+ * notify_init is deferred until a notification is actually shown. Without a
+ * notification daemon, notifications are disabled so commands still run.
+ */
+static bool notification_open()
+{
+  if (notification)
+    return true;
+  if (!notify_init(notification_appname)) {
+    warnx("Failed to initialize notifications, disabling them");
+    notifications_enabled = false;
+    return false;
+  }
+  notification = notify_notification_new("", NULL, notification_icon);
+  notify_notification_set_timeout(notification, notification_expires);
+  return true;
+}
+#endif
 
 static char *msgcmd = NULL;
-static char *msgcmdbuf = NULL;
+static char msgcmdbuf[EXEC_MAX_LENGTH];
 
 void notification_init(char* appname, char *icon, int expires)
 {
+#ifdef NOTIFY_SDBUS
+  bus_init(appname, icon, expires);
+#else
+  notification_appname = appname;
   notification_icon = icon;
-  if (!notify_init(appname))
-    err(EXIT_FAILURE, "Failed to initialize notifications");
-  notification = notify_notification_new("", NULL, icon);
-  notify_notification_set_timeout(notification, expires);
+  notification_expires = expires;
+#endif
+  notifications_enabled = true;
+}
+
+void notification_uninit()
+{
+#ifdef NOTIFY_SDBUS
+  bus_uninit();
+#else
+  if (notify_is_initted())
+    notify_uninit();
+#endif
 }
 
 void set_message_command(char *command)
@@ -33,27 +72,47 @@ void notify(char *msg, NotifyUrgency urgency, BatteryState battery)
 {
   char body[20];
   char level[8];
-  size_t needed;
+
+  if (msgcmd[0] == '\0' && (!notifications_enabled || msg[0] == '\0'))
+    return;
+
+  snprintf(body, sizeof(body), "Battery level: %u%%", battery.level);
+  snprintf(level, sizeof(level), "%d", battery.level);
+  notify_text(msg, urgency, body, level);
+}
+
+/* show msg with body, and fill value in for the level of the message command */
+void notify_text(char *msg, NotifyUrgency urgency, char *body, char *value)
+{
+  if (msgcmd[0] != '\0' || (notifications_enabled && msg[0] != '\0'))
+    stats.notifications++;
 
   if (msgcmd[0] != '\0') {
-    snprintf(level, 8, "%d", battery.level);
-    needed = snprintf(NULL, 0, msgcmd, msg, level);
-    msgcmdbuf = realloc(msgcmdbuf, needed + 1);
-    if (msgcmdbuf == NULL)
-      err(EXIT_FAILURE, "Memory allocation failed");
-    sprintf(msgcmdbuf, msgcmd, msg, level);
-    if (system(msgcmdbuf) == -1) { /* Ignore command errors... */ }
+    if (snprintf(msgcmdbuf, sizeof(msgcmdbuf), msgcmd, msg, value) < (int)sizeof(msgcmdbuf))
+      exec_command(msgcmdbuf, false);
+    else
+      warnx("Message command too long, skipping: %s", msg);
   }
 
-  if (notification && msg[0] != '\0') {
-    sprintf(body, "Battery level: %u%%", battery.level);
+  if (notifications_enabled && msg[0] != '\0') {
+#ifdef NOTIFY_SDBUS
+    bus_notify(msg, body, urgency);
+#else
+    if (!notification_open())
+      return;
     notify_notification_update(notification, msg, body, notification_icon);
     notify_notification_set_urgency(notification, urgency);
     notify_notification_show(notification, NULL);
+#endif
   }
 }
 
 void close_notification()
 {
-  notify_notification_close(notification, NULL);
+#ifdef NOTIFY_SDBUS
+  bus_close_notification();
+#else
+  if (notification)
+    notify_notification_close(notification, NULL);
+#endif
 }
@@ -5,13 +5,19 @@
 #ifndef NOTIFY_H
 #define NOTIFY_H
 
+#ifdef NOTIFY_SDBUS
+#include "bus.h"
+#else
 #include <libnotify/notification.h>
 #include <libnotify/notify.h>
+#endif
 #include "battery.h"
 
 void notification_init(char* appname, char *icon, int expires);
+void notification_uninit();
 void set_message_command(char *command);
 void notify(char *msg, NotifyUrgency urgency, BatteryState battery);
+void notify_text(char *msg, NotifyUrgency urgency, char *body, char *value);
 void close_notification();
 
 #endif
@@ -2,148 +2,131 @@
  * Copyright (c) 2018-2024 Corey Hinshaw
  */
 
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include "options.h"
 #include <err.h>
 #include <errno.h>
-#include <libnotify/notify.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "main.h"
+#include "notify.h"
+#include "threshold.h"
+#include "tier.h"
 
-static int split(char *in, char delim, char ***out)
+/* split in on delim into copies in the arena, skipping empty fields */
+static int split(char *in, char delim, char ***out, Arena *arena)
 {
   int count = 1;
+  char *end;
 
-  if (in[0] == '\0')
-    return 0;
-
-  char *p = in;
-  while (*p != '\0') {
+  for (char *p = in; *p != '\0'; p++) {
     if (*p == delim)
       count++;
-    p++;
   }
 
-  *out = (char **)realloc(*out, sizeof(char **) * (count));
-  if (*out == NULL)
-    err(EXIT_FAILURE, "Memory allocation failed");
-
-  (*out)[0] = strtok(in, &delim);
-  for (int i = 1; i < count; i++) {
-    char *tok = strtok(NULL, &delim);
-    if (tok)
-      (*out)[i] = tok;
-    else {
-      count--;
-      i--;
-    }
+  *out = arena_alloc(arena, sizeof(char *) * count);
+  count = 0;
+  for (; *in != '\0'; in = *end ? end + 1 : end) {
+    end = strchrnul(in, delim);
+    if (end > in)
+      (*out)[count++] = arena_strndup(arena, in, end - in);
   }
 
   return count;
 }
 
-char* find_config_file()
+static bool config_exists(char *path, size_t size, char *dir, char *name)
 {
-  char *config_file = NULL;
-  char *config_paths[5];
+  if (dir == NULL || dir[0] == '\0')
+    return false;
+  if (snprintf(path, size, "%s%s", dir, name) >= (int)size)
+    return false;
+  return access(path, F_OK) == 0;
+}
+
+char* find_config_file(Arena *arena)
+{
+  char path[PATH_MAX];
   char *home = getenv("HOME");
   char *config_home = getenv("XDG_CONFIG_HOME");
 
-  config_paths[0] = getenv(PROGUPPER "_CONFIG");
-  if (config_home == NULL || config_home[0] == '\0') {
-    config_paths[1] = malloc(strlen(home) + strlen("/.config/" PROGNAME) + 1);
-    if (config_paths[1] == NULL)
-      err(EXIT_FAILURE, "Memory allocation failed");
-    strcpy(config_paths[1], home);
-    strcat(config_paths[1], "/.config/" PROGNAME);
-  } else {
-    config_paths[1] = malloc(strlen(config_home) + strlen("/" PROGNAME) + 1);
-    if (config_paths[1] == NULL)
-      err(EXIT_FAILURE, "Memory allocation failed");
-    strcpy(config_paths[1], config_home);
-    strcat(config_paths[1], "/" PROGNAME);
-  }
-  config_paths[2] = malloc(strlen(home) + strlen("/." PROGNAME) + 1);
-  if (config_paths[2] == NULL)
-    err(EXIT_FAILURE, "Memory allocation failed");
-  strcpy(config_paths[2], home);
-  strcat(config_paths[2], "/." PROGNAME);
-  config_paths[3] = "/usr/local/etc/" PROGNAME;
-  config_paths[4] = "/etc/" PROGNAME;
+  if (config_home == NULL || config_home[0] == '\0')
+    config_home = NULL;
 
-  for (int i = 0; i < 5; i++) {
-    if (config_paths[i] && access(config_paths[i], F_OK) == 0) {
-      config_file = strdup(config_paths[i]);
-      if (config_file == NULL)
-        err(EXIT_FAILURE, "Memory allocation failed");
-    }
-  }
+  /* the last existing location wins, so probe in reverse and stop early */
+  if (!config_exists(path, sizeof(path), "/etc/" PROGNAME, "") &&
+      !config_exists(path, sizeof(path), "/usr/local/etc/" PROGNAME, "") &&
+      !config_exists(path, sizeof(path), home, "/." PROGNAME) &&
+      !(config_home ?
+        config_exists(path, sizeof(path), config_home, "/" PROGNAME) :
+        config_exists(path, sizeof(path), home, "/.config/" PROGNAME)) &&
+      !config_exists(path, sizeof(path), getenv(PROGUPPER "_CONFIG"), ""))
+    return NULL;
 
-  free(config_paths[1]);
-  free(config_paths[2]);
-  return config_file;
+  return arena_strdup(arena, path);
 }
 
-char** read_config_file(char *path, int *argc, char *argv0)
+char** read_config_file(char *path, int *argc, char *argv0, Arena *arena)
 {
   char **argv;
-  FILE *file;
-  size_t numlines_allocated = 128;
-  char **ptr;
+  char *data;
+  char *line;
   char *end;
-  ssize_t numchars;
-  size_t maxbytes = 0;
-  size_t buffer_increment = 512 * sizeof(char*);
+  struct stat st;
+  ssize_t len;
+  size_t size = 0;
+  int lines = 1;
+  int fd;
 
-  file = fopen(path, "r");
-  if (file == NULL) {
-    err(EXIT_FAILURE, "Could not read %s", path);
+  /* read the whole file into a single buffer and split it in place */
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
   }
 
-  argv = malloc(numlines_allocated);
+  data = arena_alloc(arena, st.st_size + 1);
+  while (size < (size_t)st.st_size && (len = read(fd, data + size, st.st_size - size)) > 0)
+    size += len;
+  close(fd);
+  data[size] = '\0';
+
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == '\n')
+      lines++;
+  }
+
+  argv = arena_alloc(arena, sizeof(char *) * (lines + 2));
   argv[0] = argv0;
   *argc = 1;
-  ptr = argv;
-  ptr++;
 
-  while((numchars = getline(ptr, &maxbytes, file)) != -1) {
-    maxbytes = 0;
-    end = *ptr + strlen(*ptr) - 1;
-    while(end >= *ptr && ((unsigned char)*end == '\n' || (unsigned char)*end == '\r'))
-      end--;
-    end[1] = '\0';
-    if (*ptr[0] == '\0' || *ptr[0] == '#')
+  for (line = data; line < data + size; line = end + 1) {
+    end = strchrnul(line, '\n');
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
       continue;
-
-    ptr++; (*argc)++;
-    if((size_t)*argc > (numlines_allocated/sizeof(char *))) {
-      argv = realloc(argv, numlines_allocated + buffer_increment);
-      if (argv == NULL)
-        err(EXIT_FAILURE, "Memory allocation failed");
-      numlines_allocated += buffer_increment;
-      ptr = argv + *argc;
-    }
+    argv[(*argc)++] = line;
   }
 
-  *(ptr) = 0;
-  argv = realloc(argv, sizeof(char*) * *argc+1);
-  if (argv == NULL)
-    err(EXIT_FAILURE, "Memory allocation failed");
-
-  if (file)
-    fclose(file);
+  argv[*argc] = NULL;
   return argv;
 }
 
-void parse_args(int argc, char *argv[], Config *config)
+void parse_args(int argc, char *argv[], Config *config, Arena *arena)
 {
   signed int c;
   optind = 1;
 
-  while ((c = getopt(argc, argv, ":hvboiew:c:d:f:pW:C:D:F:P:U:M:Nn:m:a:I:")) != -1) {
+  while ((c = getopt(argc, argv, ":hvqboiew:c:d:f:pW:C:D:F:P:U:M:Nn:m:s:A:u:S:l:t:xT:a:I:RG:X:k:K:H:L:")) != -1) {
     switch (c) {
       case 'h':
         config->help = true;
@@ -151,6 +134,12 @@ void parse_args(int argc, char *argv[], Config *config)
       case 'v':
         config->version = true;
         break;
+      case 'q':
+        config->query = true;
+        break;
+      case 'R':
+        config->reload = true;
+        break;
       case 'b':
         config->daemonize = true;
         break;
@@ -161,17 +150,16 @@ void parse_args(int argc, char *argv[], Config *config)
         config->battery_required = false;
         break;
       case 'w':
-        config->warning = strtoul(optarg, NULL, 10);
+        threshold_parse(optarg, &config->warning);
         break;
       case 'c':
-        config->critical = strtoul(optarg, NULL, 10);
+        threshold_parse(optarg, &config->critical);
         break;
       case 'd':
-        config->danger = strtoul(optarg, NULL, 10);
+        threshold_parse(optarg, &config->danger);
         break;
       case 'f':
-        config->full = strtoul(optarg, NULL, 10);
-        config->fixed = true;
+        threshold_parse(optarg, &config->full);
         break;
       case 'p':
         config->show_charging_msg = 1;
@@ -189,6 +177,18 @@ void parse_args(int argc, char *argv[], Config *config)
       case 'F':
         config->fullmsg = optarg;
         break;
+      case 'k':
+        threshold_parse(optarg, &config->pack);
+        break;
+      case 'K':
+        config->packmsg = optarg;
+        break;
+      case 'H':
+        threshold_parse(optarg, &config->health);
+        break;
+      case 'L':
+        config->healthmsg = optarg;
+        break;
       case 'P':
         config->chargingmsg = optarg;
         break;
@@ -202,7 +202,13 @@ void parse_args(int argc, char *argv[], Config *config)
         config->show_notifications = false;
         break;
       case 'n':
-        config->battery_count = split(optarg, ',', &config->battery_names);
+        config->battery_count = split(optarg, ',', &config->battery_names, arena);
+        break;
+      case 'G':
+        config->include_count = split(optarg, ',', &config->include, arena);
+        break;
+      case 'X':
+        config->exclude_count = split(optarg, ',', &config->exclude, arena);
         break;
       case 'm':
         if (optarg[0] == '+') {
@@ -212,6 +218,34 @@ void parse_args(int argc, char *argv[], Config *config)
           config->multiplier = strtoul(optarg, NULL, 10);
         }
         break;
+      case 's':
+        config->timer_slack = strtoul(optarg, NULL, 10);
+        break;
+      case 'A':
+        config->timer_align = strtoul(optarg, NULL, 10);
+        break;
+      case 'u':
+        config->uevent = true;
+        config->uevent_fallback = strtoul(optarg, NULL, 10);
+        break;
+      case 'S':
+        config->settle = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        config->history_file = optarg;
+        break;
+      case 't':
+        /* parsed from a copy, the arguments are parsed again on reload */
+        if (config->tier_count < TIER_MAX)
+          tier_parse(arena_strdup(arena, optarg), &config->tiers[config->tier_count]);
+        config->tier_count++;
+        break;
+      case 'x':
+        config->exec_direct = true;
+        break;
+      case 'T':
+        config->command_timeout = strtoul(optarg, NULL, 10);
+        break;
       case 'a':
         config->appname = optarg;
         break;
@@ -222,36 +256,105 @@ void parse_args(int argc, char *argv[], Config *config)
         config->notification_expires = NOTIFY_EXPIRES_DEFAULT;
         break;
       case '?':
-        errx(EXIT_FAILURE, "Unknown option `-%c'.", optopt);
       case ':':
-        errx(EXIT_FAILURE, "Option -%c requires an argument.", optopt);
+        config->invalid_option = optopt;
+        config->missing_argument = c == ':';
+        break;
     }
   }
 }
 
-void validate_options(Config *config)
+static bool range_error(char *error, size_t size, char option, int max)
+{
+  snprintf(error, size, "Option -%c must be between 0 and %i.", option, max);
+  return false;
+}
+
+static bool threshold_error(char *error, size_t size, char option)
 {
-  int lowlvl = config->danger;
-  char *rangemsg = "Option -%c must be between 0 and %i.";
+  snprintf(error, size, "Option -%c must be a level between 0 and 100, up to %iWh or up to %i minutes.",
+      option, THRESHOLD_MAX_ENERGY / 1000, THRESHOLD_MAX_MINUTES / 60);
+  return false;
+}
+
+/* true if both thresholds are set in the same unit and high is not above low */
+static bool misordered(Threshold *high, Threshold *low)
+{
+  return high->value && high->unit == low->unit && high->value <= low->value;
+}
+
+bool check_options(Config *config, char *error, size_t size)
+{
+  if (config->invalid_option) {
+    if (config->missing_argument)
+      snprintf(error, size, "Option -%c requires an argument.", config->invalid_option);
+    else
+      snprintf(error, size, "Unknown option `-%c'.", config->invalid_option);
+    return false;
+  }
 
   /* Sanity check numberic values */
-  if (config->warning > 100 || config->warning < 0) errx(EXIT_FAILURE, rangemsg, 'w', 100);
-  if (config->critical > 100 || config->critical < 0) errx(EXIT_FAILURE, rangemsg, 'c', 100);
-  if (config->danger > 100 || config->danger < 0) errx(EXIT_FAILURE, rangemsg, 'd', 100);
-  if (config->full > 100 || config->full < 0) errx(EXIT_FAILURE, rangemsg, 'f', 100);
-  if (config->multiplier < 0 || config->multiplier > 3600) errx(EXIT_FAILURE, rangemsg, 'm', 3600);
+  if (!threshold_valid(&config->warning)) return threshold_error(error, size, 'w');
+  if (!threshold_valid(&config->critical)) return threshold_error(error, size, 'c');
+  if (!threshold_valid(&config->danger)) return threshold_error(error, size, 'd');
+  if (!threshold_valid(&config->full)) return threshold_error(error, size, 'f');
+  if (!threshold_valid(&config->pack)) return threshold_error(error, size, 'k');
+  if (!threshold_valid(&config->health)) return threshold_error(error, size, 'H');
+  if (config->multiplier < 0 || config->multiplier > 3600) return range_error(error, size, 'm', 3600);
+  if (config->timer_slack < 0 || config->timer_slack > 100) return range_error(error, size, 's', 100);
+  if (config->timer_align < 0 || config->timer_align > 3600) return range_error(error, size, 'A', 3600);
+  if (config->settle < 0 || config->settle > 3600) return range_error(error, size, 'S', 3600);
+  if (config->command_timeout < 0 || config->command_timeout > 86400) return range_error(error, size, 'T', 86400);
+  if (config->uevent_fallback < 0 || config->uevent_fallback > 86400) return range_error(error, size, 'u', 86400);
 
-  /* Enssure levels are correctly ordered */
-  if (config->warning && config->warning <= config->critical)
-    errx(EXIT_FAILURE, "Warning level must be greater than critical.");
-  if (config->critical && config->critical <= config->danger)
-    errx(EXIT_FAILURE, "Critical level must be greater than danger.");
+  if (config->tier_count > TIER_MAX) {
+    snprintf(error, size, "At most %i tiers can be given with -t.", TIER_MAX);
+    return false;
+  }
+  for (int i = 0; i < config->tier_count; i++) {
+    if (!tier_valid(&config->tiers[i])) {
+      snprintf(error, size, "Option -t must be LEVEL[:HYSTERESIS[:URGENCY[:MESSAGE[:COMMAND]]]], "
+          "with URGENCY low, normal or critical.");
+      return false;
+    }
+  }
 
-  /* Find highest warning level */
-  if (config->warning || config->critical)
-    lowlvl = config->warning ? config->warning : config->critical;
+  /* Enssure levels are correctly ordered, where they share a unit */
+  if (misordered(&config->warning, &config->critical) || misordered(&config->warning, &config->danger)) {
+    snprintf(error, size, "Warning level must be greater than critical.");
+    return false;
+  }
+  if (misordered(&config->critical, &config->danger)) {
+    snprintf(error, size, "Critical level must be greater than danger.");
+    return false;
+  }
 
   /* Ensure the full level is higher than the warning levels */
-  if (config->full && config->full <= lowlvl)
-    errx(EXIT_FAILURE, "Option -f must be greater than %i.", lowlvl);
+  if (config->full.unit == THRESHOLD_MINUTES) {
+    snprintf(error, size, "Option -f cannot be given in minutes.");
+    return false;
+  }
+  if (config->pack.unit != THRESHOLD_PERCENT) {
+    snprintf(error, size, "Option -k must be a percentage.");
+    return false;
+  }
+  if (config->health.unit != THRESHOLD_PERCENT) {
+    snprintf(error, size, "Option -H must be a percentage.");
+    return false;
+  }
+  if (misordered(&config->full, &config->warning) || misordered(&config->full, &config->critical) ||
+      misordered(&config->full, &config->danger)) {
+    snprintf(error, size, "Option -f must be greater than the warning levels.");
+    return false;
+  }
+
+  return true;
+}
+
+void validate_options(Config *config)
+{
+  char error[OPTIONS_ERROR_LENGTH];
+
+  if (!check_options(config, error, sizeof(error)))
+    errx(EXIT_FAILURE, "%s", error);
 }
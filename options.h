@@ -7,6 +7,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "arena.h"
+#include "threshold.h"
+#include "tier.h"
+
+#define OPTIONS_ERROR_LENGTH 128
 
 typedef struct Config {
   /* program operation options */
@@ -17,34 +22,78 @@ typedef struct Config {
   bool show_charging_msg;
   bool help;
   bool version;
+  bool query;
+  bool reload;
+
+  /* option that could not be parsed and whether it lacked an argument */
+  char invalid_option;
+  bool missing_argument;
 
   /* Battery configuration */
   char **battery_names;
   int battery_count;
 
+  /* glob patterns of batteries to use and to ignore when discovering them */
+  char **include;
+  int include_count;
+  char **exclude;
+  int exclude_count;
+
   /* check frequency multiplier (seconds) */
   int multiplier;
   bool fixed;
 
+  /* allowed delay of checks (percent) and boundary to align them to (seconds) */
+  int timer_slack;
+  int timer_align;
+
+  /* listen for kernel power supply events */
+  bool uevent;
+  int uevent_fallback;
+
+  /* time a charging status change must last before it is acted on (seconds) */
+  int settle;
+
   /* battery warning levels */
-  int warning;
-  int critical;
-  int danger;
-  int full;
+  Threshold warning;
+  Threshold critical;
+  Threshold danger;
+  Threshold full;
+
+  /* warning level of each single battery (percent) */
+  Threshold pack;
+
+  /* health of each single battery (percent of its design capacity) */
+  Threshold health;
+
+  /* additional discharge tiers */
+  Tier tiers[TIER_MAX];
+  int tier_count;
 
   /* messages for battery levels */
   char *warningmsg;
   char *criticalmsg;
   char *fullmsg;
+  char *packmsg;
+  char *healthmsg;
   char *chargingmsg;
   char *dischargingmsg;
 
   /* run this system command if battery reaches danger level */
   char *dangercmd;
 
+  /* append battery samples to this log */
+  char *history_file;
+
   /* run this system command to display a message */
   char *msgcmd;
 
+  /* run commands without a shell */
+  bool exec_direct;
+
+  /* stop commands running longer than this (seconds) */
+  int command_timeout;
+
   /* app name for notification */
   char *appname;
 
@@ -55,9 +104,10 @@ typedef struct Config {
   int notification_expires;
 } Config;
 
-char* find_config_file();
-char** read_config_file(char *path, int *argc, char *argv0);
-void parse_args(int argc, char *argv[], Config *config);
+char* find_config_file(Arena *arena);
+char** read_config_file(char *path, int *argc, char *argv0, Arena *arena);
+void parse_args(int argc, char *argv[], Config *config, Arena *arena);
+bool check_options(Config *config, char *error, size_t size);
 void validate_options(Config *config);
 
 #endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "loop.h"
+#include "options.h"
+#include "reload.h"
+
+static Config defaults;
+static int reload_argc = 0;
+static char **reload_argv = NULL;
+static bool requested = false;
+
+/* config file watched for changes */
+static char watch_dir[PATH_MAX];
+static char *watch_name = NULL;
+
+static void request_reload()
+{
+  requested = true;
+  loop_request_check();
+}
+
+static void hup_handler(int signo)
+{
+  request_reload();
+}
+
+static void inotify_handler(int fd, void *data)
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event;
+  ssize_t len;
+
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+      event = (struct inotify_event *)p;
+      if (event->len && strcmp(event->name, watch_name) == 0)
+        request_reload();
+    }
+  }
+}
+
+static bool same_list(char **a, int a_count, char **b, int b_count)
+{
+  if (a_count != b_count)
+    return false;
+  for (int i = 0; i < a_count; i++) {
+    if (strcmp(a[i], b[i]) != 0)
+      return false;
+  }
+  return true;
+}
+
+static bool same_batteries(Config *a, Config *b)
+{
+  return same_list(a->battery_names, a->battery_count, b->battery_names, b->battery_count) &&
+    same_list(a->include, a->include_count, b->include, b->include_count) &&
+    same_list(a->exclude, a->exclude_count, b->exclude, b->exclude_count);
+}
+
+/* call with the configuration before any options are parsed into it */
+void reload_init(Config *config, int argc, char *argv[])
+{
+  defaults = *config;
+  reload_argc = argc;
+  reload_argv = argv;
+  loop_signal(SIGHUP, hup_handler);
+}
+
+/* watch the directory, so files replaced by editors are noticed too */
+void reload_watch(char *config_file)
+{
+  char *slash;
+  char *dir;
+  int fd;
+
+  if (config_file == NULL)
+    return;
+  if (snprintf(watch_dir, sizeof(watch_dir), "%s", config_file) >= (int)sizeof(watch_dir))
+    errx(EXIT_FAILURE, "Config file path too long");
+  slash = strrchr(watch_dir, '/');
+  if (slash == NULL) {
+    watch_name = watch_dir;
+    dir = ".";
+  } else {
+    *slash = '\0';
+    watch_name = slash + 1;
+    dir = slash == watch_dir ? "/" : watch_dir;
+  }
+
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    err(EXIT_FAILURE, "Could not watch %s", config_file);
+  loop_add(fd, inotify_handler, NULL);
+}
+
+bool reload_requested()
+{
+  bool result = requested;
+
+  requested = false;
+  return result;
+}
+
+/* parse the config file and command line again into config, if they are valid */
+bool reload_config(Config *config, bool *rescan, Arena *arena)
+{
+  char error[OPTIONS_ERROR_LENGTH];
+  Config next = defaults;
+  char *config_file = find_config_file(arena);
+  char **conf_argv;
+  int conf_argc = 0;
+
+  /* the new configuration points into the arena, which the caller releases */
+  if (config_file) {
+    conf_argv = read_config_file(config_file, &conf_argc, NULL, arena);
+    if (conf_argv == NULL) {
+      warn("Not reloading, could not read %s", config_file);
+      return false;
+    }
+    parse_args(conf_argc, conf_argv, &next, arena);
+  }
+  parse_args(reload_argc, reload_argv, &next, arena);
+
+  if (!check_options(&next, error, sizeof(error))) {
+    warnx("Not reloading: %s", error);
+    return false;
+  }
+
+  /* these only take effect at startup */
+  next.daemonize = config->daemonize;
+  next.run_once = config->run_once;
+  next.show_notifications = config->show_notifications;
+  next.uevent = config->uevent;
+  next.uevent_fallback = config->uevent_fallback;
+  next.history_file = config->history_file;
+  next.reload = config->reload;
+  next.appname = config->appname;
+  next.icon = config->icon;
+  next.notification_expires = config->notification_expires;
+
+  *rescan = !same_batteries(config, &next);
+  *config = next;
+  return true;
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <stdbool.h>
+#include "options.h"
+
+void reload_init(Config *config, int argc, char *argv[]);
+void reload_watch(char *config_file);
+bool reload_requested();
+bool reload_config(Config *config, bool *rescan, Arena *arena);
+
+#endif
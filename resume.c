@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "battery.h"
+#include "loop.h"
+#include "resume.h"
+#include "stats.h"
+
+static int clock_fd = -1;
+static long long suspended = 0;
+static int burst = 0;
+static int last_level = -1;
+static bool last_discharging = false;
+
+/* time spent suspended since boot, in nanoseconds */
+static long long suspended_ns()
+{
+  struct timespec boottime;
+  struct timespec monotonic;
+
+  clock_gettime(CLOCK_BOOTTIME, &boottime);
+  clock_gettime(CLOCK_MONOTONIC, &monotonic);
+  return (boottime.tv_sec - monotonic.tv_sec) * 1000000000LL +
+    (boottime.tv_nsec - monotonic.tv_nsec);
+}
+
+/* start a burst of checks if the system was suspended since the last call */
+static bool detect_resume()
+{
+  long long now = suspended_ns();
+  bool resumed = now - suspended >= RESUME_MIN_SUSPEND * 1000000000LL;
+
+  suspended = now;
+  if (resumed) {
+    burst = RESUME_BURST_CHECKS;
+    stats.resumes++;
+  }
+  return resumed;
+}
+
+/* a timer that never expires, but is cancelled when the wall clock is set */
+static void arm_clock()
+{
+  struct itimerspec spec = { .it_value = { .tv_sec = LONG_MAX } };
+
+  if (timerfd_settime(clock_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) < 0)
+    err(EXIT_FAILURE, "Could not set resume timer");
+}
+
+static void clock_handler(int fd, void *data)
+{
+  uint64_t expirations;
+
+  stats.wakeups[STATS_TIMER]++;
+  if (read(fd, &expirations, sizeof(expirations)) >= 0 || errno != ECANCELED)
+    return;
+
+  /* resuming sets the wall clock too, so look at the suspend time */
+  arm_clock();
+  if (detect_resume())
+    loop_request_check();
+}
+
+void resume_init()
+{
+  suspended = suspended_ns();
+
+  clock_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (clock_fd < 0)
+    err(EXIT_FAILURE, "Could not create resume timer");
+  arm_clock();
+  loop_add(clock_fd, clock_handler, NULL);
+}
+
+unsigned int resume_interval(BatteryState *battery, unsigned int duration)
+{
+  /* catch resumes the wall clock timer did not report */
+  detect_resume();
+
+  if (burst > 0) {
+    /* stop early once two readings in a row agree */
+    if (battery->level == last_level && battery->discharging == last_discharging)
+      burst = 0;
+    else
+      burst--;
+  }
+
+  last_level = battery->level;
+  last_discharging = battery->discharging;
+  if (burst > 0 && duration > RESUME_BURST_INTERVAL)
+    return RESUME_BURST_INTERVAL;
+  return duration;
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef RESUME_H
+#define RESUME_H
+
+#include "battery.h"
+
+/* shortest suspend (seconds) treated as a resume */
+#define RESUME_MIN_SUSPEND 1
+
+/* checks run at a short interval after resuming */
+#define RESUME_BURST_CHECKS 5
+#define RESUME_BURST_INTERVAL 5
+
+void resume_init();
+unsigned int resume_interval(BatteryState *battery, unsigned int duration);
+
+#endif
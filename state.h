@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Battery state published by batsignal in $XDG_RUNTIME_DIR/batsignal.state.
+ * Readers map the file read-only and copy the state with
+ * batsignal_state_read(), which needs no system calls after the mmap.
+ */
+
+#ifndef BATSIGNAL_STATE_H
+#define BATSIGNAL_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BATSIGNAL_STATE_FILE "batsignal.state"
+#define BATSIGNAL_STATE_MAGIC 0x53544142 /* "BATS" */
+#define BATSIGNAL_STATE_VERSION 1
+
+typedef struct BatsignalState {
+  uint32_t magic;
+  uint32_t version;
+
+  /* odd while the daemon is writing, incremented twice per update */
+  uint32_t sequence;
+
+  /* battery level (percent) */
+  int32_t level;
+
+  /* summed energy of all batteries, in uWh (or uAh/percent if unknown) */
+  int64_t energy_now;
+  int64_t energy_full;
+
+  /* seconds until empty or full, -1 if unknown */
+  int64_t time_remaining;
+
+  /* wall clock time of the last battery check */
+  int64_t updated;
+
+  /* 0 AC, 1 discharging, 2 warning, 3 critical, 4 danger, 5 full */
+  uint8_t state;
+  uint8_t discharging;
+
+  /* battery level in tenths of a percent, 0 from older versions */
+  uint16_t level_tenths;
+  uint8_t padding[4];
+} BatsignalState;
+
+/* copy a consistent snapshot of the shared state, false if invalid */
+static inline bool batsignal_state_read(const BatsignalState *shared, BatsignalState *out)
+{
+  uint32_t sequence;
+
+  if (shared->magic != BATSIGNAL_STATE_MAGIC || shared->version != BATSIGNAL_STATE_VERSION)
+    return false;
+
+  do {
+    sequence = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+    memcpy(out, shared, sizeof(BatsignalState));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((sequence & 1) || sequence != __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED));
+
+  return true;
+}
+
+#endif
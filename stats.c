@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "loop.h"
+#include "stats.h"
+
+Stats stats;
+
+static struct timespec loop_start;
+
+static double seconds(struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void dump_handler(int signo)
+{
+  stats_print(stdout);
+}
+
+void stats_init()
+{
+  loop_signal(SIGUSR2, dump_handler);
+}
+
+void stats_loop_begin()
+{
+  clock_gettime(CLOCK_MONOTONIC, &loop_start);
+}
+
+void stats_loop_end()
+{
+  struct timespec end;
+  long usec;
+  int bucket = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  usec = (end.tv_sec - loop_start.tv_sec) * 1000000 + (end.tv_nsec - loop_start.tv_nsec) / 1000;
+  while (usec > 1 && bucket < STATS_BUCKETS - 1) {
+    usec >>= 1;
+    bucket++;
+  }
+  stats.loop_time[bucket]++;
+  stats.checks++;
+}
+
+void stats_print(FILE *file)
+{
+  struct rusage self;
+  struct rusage children;
+
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+
+  fprintf(file, "Wakeups:           timer %lu, signal %lu, uevent %lu, socket %lu\n",
+      stats.wakeups[STATS_TIMER], stats.wakeups[STATS_SIGNAL],
+      stats.wakeups[STATS_UEVENT], stats.wakeups[STATS_SOCKET]);
+  fprintf(file, "Battery checks:    %lu\n", stats.checks);
+  fprintf(file, "Resumes:           %lu\n", stats.resumes);
+  fprintf(file, "Debounced changes: %lu\n", stats.debounced);
+  fprintf(file, "Config reloads:    %lu\n", stats.reloads);
+  fprintf(file, "Health samples:    %lu\n", stats.health_samples);
+  fprintf(file, "Sysfs reads:       %lu (%lu bytes)\n", stats.sysfs_reads, stats.bytes_read);
+  fprintf(file, "Commands spawned:  %lu\n", stats.commands);
+  fprintf(file, "Notifications:     %lu\n", stats.notifications);
+  fprintf(file, "CPU time:          %.3fs user, %.3fs system\n",
+      seconds(&self.ru_utime), seconds(&self.ru_stime));
+  fprintf(file, "Command CPU time:  %.3fs user, %.3fs system\n",
+      seconds(&children.ru_utime), seconds(&children.ru_stime));
+
+  fprintf(file, "Check time:");
+  for (int i = 0; i < STATS_BUCKETS; i++) {
+    if (stats.loop_time[i])
+      fprintf(file, " %s%luus:%lu", i == STATS_BUCKETS - 1 ? ">=" : "<", 2UL << i, stats.loop_time[i]);
+  }
+  fprintf(file, "\n");
+  fflush(file);
+}
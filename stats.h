@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* wakeup causes */
+#define STATS_TIMER 0
+#define STATS_SIGNAL 1
+#define STATS_UEVENT 2
+#define STATS_SOCKET 3
+#define STATS_CAUSES 4
+
+/* loop iteration histogram buckets, powers of two in microseconds */
+#define STATS_BUCKETS 16
+
+typedef struct Stats {
+  unsigned long wakeups[STATS_CAUSES];
+  unsigned long checks;
+  unsigned long resumes;
+  unsigned long debounced;
+  unsigned long reloads;
+  unsigned long health_samples;
+  unsigned long sysfs_reads;
+  unsigned long bytes_read;
+  unsigned long commands;
+  unsigned long notifications;
+  unsigned long loop_time[STATS_BUCKETS];
+} Stats;
+
+extern Stats stats;
+
+void stats_init();
+void stats_loop_begin();
+void stats_loop_end();
+void stats_print(FILE *file);
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Micro-benchmarks for the battery polling path. Each benchmark reports the
+ * wall time per operation and the number of system calls per operation,
+ * counted by tracing a forked copy of the benchmark with ptrace.
+ *
+ * Usage: bench [-u] [BASELINE [BATSIGNAL]]
+ *   Compare results against BASELINE, or rewrite it with -u. When the
+ *   BATSIGNAL binary is given, also time it from exec to exit in -o mode.
+ *   Only an increase in system calls fails the comparison.
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "battery.h"
+#include "notify.h"
+
+#define BENCH_MAX 16
+#define BENCH_NAME_LENGTH 32
+
+/* allowed increase in system calls per operation before reporting a regression */
+#define BENCH_SYSCALL_TOLERANCE 0.05
+
+typedef struct Result {
+  char name[BENCH_NAME_LENGTH];
+  double ns;
+  double syscalls;
+} Result;
+
+typedef void (*BenchFunction)(void *data);
+
+static char workdir[] = "/tmp/batsignal-bench.XXXXXX";
+static char *fakebat = "test/fakebat.sh";
+static char *batsignal = NULL;
+static Result results[BENCH_MAX];
+static int result_count = 0;
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* count system calls made by a forked child running the function */
+static double count_syscalls(BenchFunction function, void *data, int iterations)
+{
+  pid_t pid;
+  int status;
+  long count = 0;
+
+  pid = fork();
+  if (pid < 0)
+    err(EXIT_FAILURE, "fork");
+  if (pid == 0) {
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    raise(SIGSTOP);
+    for (int i = 0; i < iterations; i++)
+      function(data);
+    _exit(EXIT_SUCCESS);
+  }
+
+  waitpid(pid, &status, 0);
+  ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+  for (;;) {
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    if (waitpid(pid, &status, 0) < 0 || WIFEXITED(status) || WIFSIGNALED(status))
+      break;
+    if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80))
+      count++;
+  }
+
+  /* each call stops on entry and exit, minus the SIGSTOP and exit_group */
+  return count > 2 ? (count - 2) / 2.0 / iterations : 0;
+}
+
+/* time function, but count the system calls of a single call to traced */
+static void run_traced(char *name, BenchFunction function, BenchFunction traced,
+    void *data, int iterations, int traced_iterations)
+{
+  struct timespec start;
+  struct timespec end;
+  Result *result = &results[result_count++];
+
+  function(data);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < iterations; i++)
+    function(data);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  snprintf(result->name, BENCH_NAME_LENGTH, "%s", name);
+  result->ns = elapsed_ns(&start, &end) / iterations;
+  result->syscalls = count_syscalls(traced, data, traced_iterations);
+  printf("%-24s %12.0f ns/op %8.1f syscalls/op\n", result->name, result->ns, result->syscalls);
+}
+
+static void run(char *name, BenchFunction function, void *data, int iterations)
+{
+  run_traced(name, function, function, data, iterations, iterations < 20 ? iterations : 20);
+}
+
+static void fixture(char *root, char *args)
+{
+  char command[512];
+
+  snprintf(command, sizeof(command), "sh %s %s", fakebat, args);
+  if (system(command) != 0)
+    errx(EXIT_FAILURE, "Could not create fixture in %s", root);
+}
+
+static void bench_update(void *data)
+{
+  update_battery_state(data, true);
+}
+
+static void bench_find(void *data)
+{
+  char **names = NULL;
+  Battery *batteries = NULL;
+  Arena arena = { NULL };
+  int count = find_batteries(&names, &batteries, &arena);
+
+  close_batteries(batteries, count);
+  arena_free(&arena);
+}
+
+static void bench_notify(void *data)
+{
+  notify("Battery is low", NOTIFY_URGENCY_NORMAL, *(BatteryState *)data);
+}
+
+static void exec_batsignal(void *data)
+{
+  int fd = open("/dev/null", O_WRONLY);
+
+  dup2(fd, STDOUT_FILENO);
+  execl(batsignal, batsignal, "-o", "-N", (char *)NULL);
+  _exit(EXIT_FAILURE);
+}
+
+static void bench_startup(void *data)
+{
+  int status;
+  pid_t pid = fork();
+
+  if (pid < 0)
+    err(EXIT_FAILURE, "fork");
+  if (pid == 0)
+    exec_batsignal(data);
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    errx(EXIT_FAILURE, "%s -o failed", batsignal);
+}
+
+static void update_benchmarks()
+{
+  int counts[] = { 1, 2, 8, 64 };
+  char root[128];
+  char args[256];
+  char name[BENCH_NAME_LENGTH];
+  BatteryState battery = { .arena = { NULL } };
+
+  for (int i = 0; i < 4; i++) {
+    snprintf(root, sizeof(root), "%s/update%d", workdir, counts[i]);
+    snprintf(args, sizeof(args), "many %s %d energy 50", root, counts[i]);
+    mkdir(root, 0755);
+    fixture(root, args);
+
+    set_power_supply_path(strdup(root));
+    battery.count = find_batteries(&battery.names, &battery.batteries, &battery.arena);
+
+    snprintf(name, sizeof(name), "update_battery_state/%d", counts[i]);
+    run(name, bench_update, &battery, 20000 / counts[i]);
+    close_batteries(battery.batteries, battery.count);
+    arena_free(&battery.arena);
+  }
+}
+
+static void find_benchmark()
+{
+  char root[128];
+  char args[256];
+
+  /* a docking station full of peripherals with two real batteries */
+  snprintf(root, sizeof(root), "%s/find", workdir);
+  mkdir(root, 0755);
+  for (int i = 0; i < 300; i++) {
+    snprintf(args, sizeof(args), "supply %s hid-%04d-battery %s Device", root, i, i % 3 ? "Battery" : "USB");
+    fixture(root, args);
+  }
+  snprintf(args, sizeof(args), "many %s 2 energy 50", root);
+  fixture(root, args);
+
+  set_power_supply_path(strdup(root));
+  run("find_batteries/302", bench_find, NULL, 50);
+}
+
+static void notify_benchmark()
+{
+  BatteryState battery = { .level = 10 };
+
+  set_message_command("");
+  run("notify/disabled", bench_notify, &battery, 100000);
+}
+
+static void startup_benchmark()
+{
+  char root[128];
+  char args[256];
+
+  snprintf(root, sizeof(root), "%s/startup", workdir);
+  snprintf(args, sizeof(args), "many %s 1 energy 50", root);
+  mkdir(root, 0755);
+  fixture(root, args);
+
+  /* keep configuration files and the running daemon out of the measurement */
+  setenv("BATSIGNAL_POWER_SUPPLY", root, 1);
+  setenv("XDG_RUNTIME_DIR", workdir, 1);
+  setenv("HOME", workdir, 1);
+  unsetenv("XDG_CONFIG_HOME");
+  unsetenv("BATSIGNAL_CONFIG");
+
+  run_traced("startup/run_once", bench_startup, exec_batsignal, NULL, 200, 1);
+}
+
+static int compare_baseline(char *path)
+{
+  FILE *file = fopen(path, "r");
+  char name[BENCH_NAME_LENGTH];
+  double ns;
+  double syscalls;
+  int regressions = 0;
+
+  if (file == NULL) {
+    warn("Could not read baseline %s", path);
+    return 0;
+  }
+
+  printf("\nCompared to %s:\n", path);
+  while (fscanf(file, "%31s %lf %lf", name, &ns, &syscalls) == 3) {
+    for (int i = 0; i < result_count; i++) {
+      if (strcmp(results[i].name, name) != 0)
+        continue;
+      printf("%-24s %+7.1f%% time %+6.1f syscalls", name,
+          100.0 * (results[i].ns - ns) / ns, results[i].syscalls - syscalls);
+      /* timings depend on the machine, so only the system call count is gated */
+      if (results[i].syscalls > syscalls + BENCH_SYSCALL_TOLERANCE) {
+        printf("  REGRESSION");
+        regressions++;
+      }
+      printf("\n");
+    }
+  }
+  fclose(file);
+  return regressions;
+}
+
+static void write_baseline(char *path)
+{
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL)
+    err(EXIT_FAILURE, "Could not write baseline %s", path);
+  for (int i = 0; i < result_count; i++)
+    fprintf(file, "%s %.0f %.1f\n", results[i].name, results[i].ns, results[i].syscalls);
+  fclose(file);
+  printf("\nWrote baseline %s\n", path);
+}
+
+static void remove_workdir()
+{
+  char command[64];
+
+  snprintf(command, sizeof(command), "rm -rf %s", workdir);
+  if (system(command) != 0) { /* Ignore cleanup errors... */ }
+}
+
+int main(int argc, char *argv[])
+{
+  bool update = argc > 1 && strcmp(argv[1], "-u") == 0;
+  char *baseline = argc > 1 + update ? argv[1 + update] : NULL;
+
+  if (argc > 2 + update)
+    batsignal = argv[2 + update];
+
+  if (mkdtemp(workdir) == NULL)
+    err(EXIT_FAILURE, "Could not create %s", workdir);
+  atexit(remove_workdir);
+
+  update_benchmarks();
+  find_benchmark();
+  notify_benchmark();
+  if (batsignal)
+    startup_benchmark();
+
+  if (baseline && update)
+    write_baseline(baseline);
+  else if (baseline && compare_baseline(baseline) > 0)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
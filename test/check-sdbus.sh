@@ -0,0 +1,127 @@
+#!/bin/sh
+#
+# Check the sd-bus notification backend against a stub notification server
+# on a private session bus. BATSIGNAL must be built with NOTIFY=sdbus.
+#
+# Usage: check-sdbus.sh [BATSIGNAL]
+
+BATSIGNAL=${1:-./batsignal}
+FAKEBAT="$(dirname "$0")/fakebat.sh"
+NOTIFYD="$(dirname "$0")/notifyd"
+DBUS_DAEMON=${DBUS_DAEMON:-dbus-daemon}
+WORKDIR=$(mktemp -d)
+PID=
+SERVER=
+BUS=
+failures=0
+total=0
+
+cleanup() {
+  [ -n "$PID" ] && kill "$PID" 2>/dev/null
+  [ -n "$SERVER" ] && kill "$SERVER" 2>/dev/null
+  [ -n "$BUS" ] && kill "$BUS" 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+"$DBUS_DAEMON" --session --fork --print-address=3 --print-pid=4 \
+  3> "$WORKDIR/address" 4> "$WORKDIR/bus.pid" || exit 1
+BUS=$(cat "$WORKDIR/bus.pid")
+DBUS_SESSION_BUS_ADDRESS=$(head -n 1 "$WORKDIR/address")
+export DBUS_SESSION_BUS_ADDRESS
+
+# start a fresh notification server and battery tree for a scenario
+scenario() {
+  NAME=$1
+  ROOT=$WORKDIR/$NAME/power_supply
+  LOG=$WORKDIR/$NAME/log
+  mkdir -p "$ROOT" "$WORKDIR/$NAME/run"
+  BATSIGNAL_POWER_SUPPLY=$ROOT
+  XDG_RUNTIME_DIR=$WORKDIR/$NAME/run
+  export BATSIGNAL_POWER_SUPPLY XDG_RUNTIME_DIR
+
+  "$NOTIFYD" "$LOG" &
+  SERVER=$!
+  tries=0
+  while [ ! -f "$LOG" ]; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 100 ]; then
+      echo "  timed out waiting for the notification server" >&2
+      exit 1
+    fi
+    sleep 0.05
+  done
+}
+
+sequence() {
+  "$BATSIGNAL" -q 2>/dev/null | sed -n 's/^sequence=//p'
+}
+
+# wait until the published state has been updated past $1
+wait_for() {
+  tries=0
+  while [ "$(sequence)" = "$1" ] || [ -z "$(sequence)" ]; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 100 ]; then
+      echo "  timed out waiting for a battery check" >&2
+      return 1
+    fi
+    sleep 0.05
+  done
+}
+
+start() {
+  "$BATSIGNAL" -m 0 "$@" > "$WORKDIR/$NAME/stdout" &
+  PID=$!
+  wait_for ""
+}
+
+stop() {
+  kill "$PID" 2>/dev/null
+  wait "$PID" 2>/dev/null
+  PID=
+  kill "$SERVER" 2>/dev/null
+  wait "$SERVER" 2>/dev/null
+  SERVER=
+}
+
+# set battery $1 to level $2 (and status $3), then force a check
+step() {
+  sh "$FAKEBAT" set "$ROOT" "$1" "$2" "$3"
+  before=$(sequence)
+  kill -USR1 "$PID"
+  wait_for "$before"
+}
+
+expect() {
+  total=$((total + 1))
+  actual=$(cat "$LOG")
+  if [ "$actual" = "$1" ]; then
+    echo "PASS $NAME"
+  else
+    failures=$((failures + 1))
+    echo "FAIL $NAME"
+    echo "  expected: $(echo "$1" | tr '\n' '|')"
+    echo "  actual:   $(echo "$actual" | tr '\n' '|')"
+  fi
+}
+
+scenario replace
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -w 60 -c 40 -I battery-low
+step BAT0 30
+step BAT0 30 Charging
+stop
+expect "notify 0 app=batsignal icon=battery-low summary=Battery is low body=Battery level: 50% urgency=1 expires=0
+notify 1 app=batsignal icon=battery-low summary=Battery is critically low body=Battery level: 30% urgency=2 expires=0
+close 1"
+
+scenario expires
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -e -p
+step BAT0 50 Charging
+stop
+expect "notify 0 app=batsignal icon= summary=Battery is charging body=Battery level: 50% urgency=1 expires=-1"
+
+echo "$((total - failures)) of $total scenarios passed"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,394 @@
+#!/bin/sh
+#
+# Drive batsignal through scripted battery curves using a synthetic
+# power_supply tree. No real battery or root access is needed.
+#
+# Usage: check.sh [BATSIGNAL]
+
+BATSIGNAL=${1:-./batsignal}
+FAKEBAT="$(dirname "$0")/fakebat.sh"
+MALLOC="$(cd "$(dirname "$0")" && pwd)/malloc.so"
+PROBE="$(dirname "$0")/probe"
+WORKDIR=$(mktemp -d)
+PID=
+failures=0
+total=0
+
+cleanup() {
+  [ -n "$PID" ] && kill "$PID" 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# prepare an empty tree for a scenario
+scenario() {
+  NAME=$1
+  ROOT=$WORKDIR/$NAME/power_supply
+  LOG=$WORKDIR/$NAME/log
+  mkdir -p "$ROOT" "$WORKDIR/$NAME/run"
+  : > "$LOG"
+  BATSIGNAL_POWER_SUPPLY=$ROOT
+  XDG_RUNTIME_DIR=$WORKDIR/$NAME/run
+  export BATSIGNAL_POWER_SUPPLY XDG_RUNTIME_DIR
+}
+
+sequence() {
+  "$BATSIGNAL" -q 2>/dev/null | sed -n 's/^sequence=//p'
+}
+
+# wait until the published state has been updated past $1
+wait_for() {
+  tries=0
+  while [ "$(sequence)" = "$1" ] || [ -z "$(sequence)" ]; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 100 ]; then
+      echo "  timed out waiting for a battery check" >&2
+      return 1
+    fi
+    sleep 0.05
+  done
+  # let spawned message commands finish
+  sleep 0.1
+}
+
+# start the daemon; checks happen only when requested
+start() {
+  "$BATSIGNAL" -N -m 0 -M "echo %s %s >> $LOG" "$@" > "$WORKDIR/$NAME/stdout" &
+  PID=$!
+  wait_for ""
+}
+
+stop() {
+  kill "$PID" 2>/dev/null
+  wait "$PID" 2>/dev/null
+  PID=
+  sleep 0.1
+}
+
+# set battery $1 to level $2 (and status $3), then force a check
+step() {
+  sh "$FAKEBAT" set "$ROOT" "$1" "$2" "$3"
+  before=$(sequence)
+  kill -USR1 "$PID"
+  wait_for "$before"
+}
+
+# set energy_now of battery $1 to $2 uWh, then force a check
+step_energy() {
+  echo "$2" > "$ROOT/$1/energy_now"
+  before=$(sequence)
+  kill -USR1 "$PID"
+  wait_for "$before"
+}
+
+expect() {
+  total=$((total + 1))
+  actual=$(cat "$LOG")
+  if [ "$actual" = "$1" ]; then
+    echo "PASS $NAME"
+  else
+    failures=$((failures + 1))
+    echo "FAIL $NAME"
+    echo "  expected: $(echo "$1" | tr '\n' '|')"
+    echo "  actual:   $(echo "$actual" | tr '\n' '|')"
+  fi
+}
+
+scenario discharge
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -w 15 -c 5 -d 2 -D "echo danger >> $LOG"
+for level in 30 16 15 12 6 5 3 2 1; do
+  step BAT0 $level
+done
+stop
+expect "Battery is low 15
+Battery is critically low 5
+danger"
+
+scenario charge
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -p -f 90
+step BAT0 50 Charging
+step BAT0 85
+step BAT0 90
+step BAT0 89 Discharging
+stop
+expect "Battery is charging 50
+Battery is full 90
+Battery is discharging 89"
+
+scenario debounce
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -p -S 1
+step BAT0 50 Charging
+step BAT0 50 Discharging
+step BAT0 50 Charging
+before=$(sequence)
+sleep 1.5
+wait_for "$before"
+stop
+expect "Battery is charging 50"
+
+scenario reload
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+BATSIGNAL_CONFIG=$WORKDIR/$NAME/config
+export BATSIGNAL_CONFIG
+printf -- '-w\n20\n' > "$BATSIGNAL_CONFIG"
+start
+step BAT0 25
+printf -- '-w\n30\n' > "$BATSIGNAL_CONFIG"
+before=$(sequence)
+kill -HUP "$PID"
+wait_for "$before"
+step BAT0 24
+stop
+unset BATSIGNAL_CONFIG
+expect "Battery is low 25"
+
+scenario tiers
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+CMDLOG=$WORKDIR/$NAME/commands
+start -w 0 -c 0 -d 0 -t "40:5:low:Plan to charge:echo tiercmd >> $CMDLOG" -t "20::critical:Charge now"
+step BAT0 39
+step BAT0 43
+step BAT0 38
+step BAT0 46
+step BAT0 39
+before=$(sequence)
+kill -HUP "$PID"
+wait_for "$before"
+step BAT0 46
+step BAT0 39
+step BAT0 20
+stop
+cat "$CMDLOG" >> "$LOG"
+expect "Plan to charge 39
+Plan to charge 39
+Plan to charge 39
+Charge now 20
+tiercmd
+tiercmd
+tiercmd"
+
+scenario fractional
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -w 2.5 -c 0 -d 0
+step_energy BAT0 1300000
+step_energy BAT0 1250000
+stop
+expect "Battery is low 3"
+
+scenario energy
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -w 4Wh -c 0 -d 0
+step BAT0 9
+step BAT0 8
+stop
+expect "Battery is low 8"
+
+scenario noenergy
+sh "$FAKEBAT" battery "$ROOT" BAT0 capacity 80
+"$BATSIGNAL" -N -o -m 0 -w 0 -c 0 -d 4Wh -D "echo danger >> $LOG" > /dev/null 2>&1
+sleep 0.1
+expect ""
+
+scenario minutes
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 2
+sh "$FAKEBAT" break "$ROOT" BAT0 power_now missing
+start -w 10min -c 0 -d 0
+stop
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -w 10min -c 0 -d 0
+step BAT0 4
+step BAT0 3
+stop
+expect "Battery is low 3"
+
+scenario busy
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -M "sleep 3 # %s %s" -t 40:::Soon -t 35:::Sooner -t 30:::Now -w 25 -c 0 -d 20 -D "echo danger >> $LOG"
+for level in 39 34 29 24 19; do
+  step BAT0 $level
+done
+stop
+expect "danger"
+
+scenario mixed
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+sh "$FAKEBAT" battery "$ROOT" BAT1 charge 50
+start -w 25
+step BAT0 10
+step BAT1 30
+stop
+expect "Battery is low 20"
+
+scenario packs
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 90
+sh "$FAKEBAT" battery "$ROOT" BAT1 energy 50
+start -k 20
+step BAT1 15
+step BAT1 14
+step BAT1 30
+step BAT1 19
+stop
+expect "Battery pack is low: BAT1 15
+Battery pack is low: BAT1 19"
+
+scenario health
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+echo 40000000 > "$ROOT/BAT0/energy_full"
+start -H 85
+step BAT0 40
+step BAT0 30
+stop
+expect "Battery health is low: BAT0 80"
+
+scenario packflap
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 90
+sh "$FAKEBAT" battery "$ROOT" BAT1 energy 15
+start -k 20 -S 5
+step BAT1 15
+sh "$FAKEBAT" set "$ROOT" BAT0 90 Charging
+step BAT1 15 Charging
+sh "$FAKEBAT" set "$ROOT" BAT0 90 Discharging
+step BAT1 15 Discharging
+stop
+expect "Battery pack is low: BAT1 15"
+
+scenario units
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+sh "$FAKEBAT" battery "$ROOT" BAT1 capacity 50
+start -w 25
+step BAT0 10
+step BAT1 30
+stop
+expect "Battery is low 20"
+
+scenario capacity
+sh "$FAKEBAT" battery "$ROOT" BAT0 capacity 50
+start -w 25
+step BAT0 10
+stop
+expect "Battery is low 10"
+
+scenario missing
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+start -i -n BAT0,BAT1 -w 25
+step BAT0 20
+sh "$FAKEBAT" battery "$ROOT" BAT1 energy 80
+step BAT0 21
+stop
+expect "Battery is low 20"
+
+scenario malformed
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+sh "$FAKEBAT" break "$ROOT" BAT0 energy_now malformed
+total=$((total + 1))
+if "$BATSIGNAL" -N -o -m 0 > /dev/null 2>&1; then
+  failures=$((failures + 1))
+  echo "FAIL $NAME"
+else
+  echo "PASS $NAME"
+fi
+
+scenario unreadable
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+sh "$FAKEBAT" break "$ROOT" BAT0 energy_now malformed
+"$BATSIGNAL" -N -o -i -n BAT0 -m 0 -D "echo danger >> $LOG" > /dev/null 2>&1
+sleep 0.1
+expect ""
+
+scenario discovery
+sh "$FAKEBAT" supply "$ROOT" AC Mains
+sh "$FAKEBAT" battery "$ROOT" BAT1 energy 50
+sh "$FAKEBAT" battery "$ROOT" BAT0 charge 50
+sh "$FAKEBAT" battery "$ROOT" CMB0 capacity 50
+sh "$FAKEBAT" break "$ROOT" CMB0 capacity missing
+sh "$FAKEBAT" battery "$ROOT" hid-mouse capacity 50
+echo Device > "$ROOT/hid-mouse/scope"
+start
+stop
+sed -n 's/^Using batteries: *//p' "$WORKDIR/$NAME/stdout" | tr ',' '\n' | tr -d ' ' | sort > "$LOG"
+expect "BAT0
+BAT1"
+
+scenario patterns
+sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+sh "$FAKEBAT" battery "$ROOT" BAT1 energy 50
+sh "$FAKEBAT" battery "$ROOT" hid-mouse capacity 50
+echo Device > "$ROOT/hid-mouse/scope"
+start -G "BAT*,hid-*" -X BAT1
+stop
+sed -n 's/^Using batteries: *//p' "$WORKDIR/$NAME/stdout" | tr ',' '\n' | tr -d ' ' | sort > "$LOG"
+expect "BAT0
+hid-mouse"
+
+scenario control
+if [ -x "$PROBE" ]; then
+  sh "$FAKEBAT" many "$ROOT" 6 energy 50
+  start -w 25
+  step BAT5 20
+  OUT=$WORKDIR/$NAME/replies
+  "$PROBE" control batteries | sed 's/ .*level_tenths=\([0-9]*\).*/ \1/' | sort > "$OUT"
+  "$PROBE" control state | grep '^level=' >> "$OUT"
+  before=$(sequence)
+  "$PROBE" control "set warning 60" >> "$OUT"
+  wait_for "$before"
+  stop
+  cat "$OUT" >> "$LOG"
+  expect "Battery is low 45
+name=BAT0 500
+name=BAT1 500
+name=BAT2 500
+name=BAT3 500
+name=BAT4 500
+name=BAT5 200
+level=45
+ok"
+else
+  echo "SKIP $NAME, $PROBE not built"
+fi
+
+scenario history
+if [ -x "$PROBE" ]; then
+  sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+  start -l "$WORKDIR/$NAME/history"
+  step BAT0 40
+  step BAT0 30 Charging
+  stop
+  "$PROBE" log "$WORKDIR/$NAME/history" | cut -d' ' -f1-3 > "$LOG"
+  expect "battery=0 status=2 energy_now=25000000
+battery=0 status=2 energy_now=20000000
+battery=0 status=1 energy_now=15000000"
+else
+  echo "SKIP $NAME, $PROBE not built"
+fi
+
+# heap allocations made while running levels $@, after the priming check
+allocations() {
+  LD_PRELOAD=$MALLOC
+  BATSIGNAL_MALLOC_COUNT=$WORKDIR/$NAME/malloc
+  export LD_PRELOAD BATSIGNAL_MALLOC_COUNT
+  start -w 15 -c 5 -D "true"
+  for level in "$@"; do
+    step BAT0 "$level"
+  done
+  daemon=$PID
+  stop
+  unset LD_PRELOAD BATSIGNAL_MALLOC_COUNT
+  cat "$WORKDIR/$NAME/malloc.$daemon"
+}
+
+scenario allocations
+if [ -f "$MALLOC" ]; then
+  sh "$FAKEBAT" battery "$ROOT" BAT0 energy 50
+  few=$(allocations 40 10)
+  many=$(allocations 40 10 9 6 5 2 40 30 10 5 40 2 1)
+  echo "$((many - few)) more allocations" > "$LOG"
+  expect "0 more allocations"
+else
+  echo "SKIP $NAME, $MALLOC not built"
+fi
+
+echo "$((total - failures)) of $total scenarios passed"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+# Build synthetic power_supply trees for testing and benchmarking.
+#
+# Usage:
+#   fakebat.sh battery ROOT NAME FAMILY LEVEL [STATUS]
+#       create a battery using the charge, energy or capacity attributes
+#   fakebat.sh set ROOT NAME LEVEL [STATUS]
+#       change the level (and status) of an existing battery
+#   fakebat.sh supply ROOT NAME TYPE [SCOPE]
+#       create a non-battery supply such as Mains or USB
+#   fakebat.sh break ROOT NAME ATTRIBUTE missing|malformed
+#       remove an attribute or replace its value with garbage
+#   fakebat.sh many ROOT COUNT FAMILY LEVEL
+#       create COUNT batteries named BAT0..BATn
+
+set -e
+
+FULL_ENERGY=50000000
+FULL_CHARGE=4500000
+VOLTAGE=11100000
+
+# write VALUE to ROOT/NAME/ATTRIBUTE
+attr() {
+  printf '%s\n' "$4" > "$1/$2/$3"
+}
+
+battery() {
+  mkdir -p "$1/$2"
+  attr "$1" "$2" type Battery
+  attr "$1" "$2" status "${5:-Discharging}"
+  case "$3" in
+    charge)
+      attr "$1" "$2" charge_full "$FULL_CHARGE"
+      attr "$1" "$2" charge_full_design "$FULL_CHARGE"
+      attr "$1" "$2" current_now 1500000
+      attr "$1" "$2" voltage_min_design "$VOLTAGE"
+      attr "$1" "$2" cycle_count 0
+      ;;
+    energy)
+      attr "$1" "$2" energy_full "$FULL_ENERGY"
+      attr "$1" "$2" energy_full_design "$FULL_ENERGY"
+      attr "$1" "$2" power_now 10000000
+      attr "$1" "$2" cycle_count 0
+      ;;
+    capacity)
+      ;;
+    *)
+      echo "Unknown family: $3" >&2
+      exit 1
+      ;;
+  esac
+  set_level "$1" "$2" "$4" "$5"
+}
+
+set_level() {
+  if [ -f "$1/$2/charge_full" ]; then
+    attr "$1" "$2" charge_now $(($(cat "$1/$2/charge_full") * $3 / 100))
+  elif [ -f "$1/$2/energy_full" ]; then
+    attr "$1" "$2" energy_now $(($(cat "$1/$2/energy_full") * $3 / 100))
+  fi
+  attr "$1" "$2" capacity "$3"
+  if [ -n "$4" ]; then
+    attr "$1" "$2" status "$4"
+  fi
+}
+
+supply() {
+  mkdir -p "$1/$2"
+  attr "$1" "$2" type "$3"
+  attr "$1" "$2" online 1
+  if [ -n "$4" ]; then
+    attr "$1" "$2" scope "$4"
+  fi
+}
+
+break_attr() {
+  case "$4" in
+    missing) rm -f "$1/$2/$3" ;;
+    malformed) attr "$1" "$2" "$3" "not a number" ;;
+    *)
+      echo "Unknown breakage: $4" >&2
+      exit 1
+      ;;
+  esac
+}
+
+many() {
+  i=0
+  while [ "$i" -lt "$2" ]; do
+    battery "$1" "BAT$i" "$3" "$4"
+    i=$((i + 1))
+  done
+}
+
+command=${1:-}
+[ $# -gt 0 ] && shift
+case "$command" in
+  battery) battery "$@" ;;
+  set) set_level "$@" ;;
+  supply) supply "$@" ;;
+  break) break_attr "$@" ;;
+  many) many "$@" ;;
+  *)
+    sed -n '3,15s/^# \{0,1\}//p' "$0" >&2
+    exit 1
+    ;;
+esac
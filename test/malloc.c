@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Heap allocation counter, preloaded into batsignal by check.sh. When a
+ * process exits, the number of allocations it made is written to the file
+ * named by BATSIGNAL_MALLOC_COUNT, with a dot and the process id appended.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocations = 0;
+
+void *malloc(size_t size)
+{
+  allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+__attribute__((destructor)) static void report()
+{
+  char *prefix = getenv("BATSIGNAL_MALLOC_COUNT");
+  char path[4096];
+  char count[24];
+  int len;
+  int fd;
+
+  if (prefix == NULL || snprintf(path, sizeof(path), "%s.%d", prefix, getpid()) >= (int)sizeof(path))
+    return;
+  len = snprintf(count, sizeof(count), "%lu\n", allocations);
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    if (write(fd, count, len) < 0) { /* Ignore... */ }
+    close(fd);
+  }
+}
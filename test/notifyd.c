@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Stub notification server for check-sdbus.sh. Owns the notification
+ * service on the session bus and appends one line per Notify or
+ * CloseNotification call to FILE. FILE is created once the name is owned.
+ *
+ * Usage: notifyd FILE
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <systemd/sd-bus.h>
+#include "bus.h"
+
+static FILE *out = NULL;
+static uint32_t last_id = 0;
+
+/* read the urgency hint, ignoring any others */
+static uint8_t read_urgency(sd_bus_message *m)
+{
+  uint8_t urgency = 0xff;
+  const char *key;
+
+  if (sd_bus_message_enter_container(m, 'a', "{sv}") < 0)
+    return urgency;
+  while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+    if (sd_bus_message_read(m, "s", &key) < 0)
+      break;
+    if (strcmp(key, "urgency") == 0)
+      sd_bus_message_read(m, "v", "y", &urgency);
+    else
+      sd_bus_message_skip(m, "v");
+    sd_bus_message_exit_container(m);
+  }
+  sd_bus_message_exit_container(m);
+  return urgency;
+}
+
+static int notify(sd_bus_message *m)
+{
+  const char *app, *icon, *summary, *body;
+  uint32_t replaces, id;
+  uint8_t urgency;
+  int32_t expires;
+
+  if (sd_bus_message_read(m, "susss", &app, &replaces, &icon, &summary, &body) < 0
+      || sd_bus_message_skip(m, "as") < 0)
+    return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Bad arguments");
+  urgency = read_urgency(m);
+  if (sd_bus_message_read(m, "i", &expires) < 0)
+    return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Bad arguments");
+
+  id = replaces ? replaces : ++last_id;
+  fprintf(out, "notify %u app=%s icon=%s summary=%s body=%s urgency=%u expires=%d\n",
+      replaces, app, icon, summary, body, urgency, expires);
+  fflush(out);
+  return sd_bus_reply_method_return(m, "u", id);
+}
+
+static int close_notification(sd_bus_message *m)
+{
+  uint32_t id;
+
+  if (sd_bus_message_read(m, "u", &id) < 0)
+    return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Bad arguments");
+  fprintf(out, "close %u\n", id);
+  fflush(out);
+  return sd_bus_reply_method_return(m, "");
+}
+
+static int handler(sd_bus_message *m, void *userdata, sd_bus_error *error)
+{
+  if (sd_bus_message_is_method_call(m, BUS_INTERFACE, "Notify"))
+    return notify(m);
+  if (sd_bus_message_is_method_call(m, BUS_INTERFACE, "CloseNotification"))
+    return close_notification(m);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  sd_bus *bus = NULL;
+  int r;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if ((r = sd_bus_open_user(&bus)) < 0)
+    errx(EXIT_FAILURE, "Could not connect to the session bus: %s", strerror(-r));
+  if ((r = sd_bus_request_name(bus, BUS_SERVICE, 0)) < 0)
+    errx(EXIT_FAILURE, "Could not own %s: %s", BUS_SERVICE, strerror(-r));
+  if ((r = sd_bus_add_filter(bus, NULL, handler, NULL)) < 0)
+    errx(EXIT_FAILURE, "Could not add a filter: %s", strerror(-r));
+  if ((out = fopen(argv[1], "a")) == NULL)
+    err(EXIT_FAILURE, "Could not open %s", argv[1]);
+
+  for (;;) {
+    r = sd_bus_process(bus, NULL);
+    if (r == 0)
+      r = sd_bus_wait(bus, UINT64_MAX);
+    if (r < 0)
+      errx(EXIT_FAILURE, "Lost the session bus: %s", strerror(-r));
+  }
+}
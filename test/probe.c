@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ *
+ * Inspect a running batsignal from check.sh.
+ *
+ * Usage:
+ *   probe control COMMAND
+ *       send COMMAND to the control socket and print the reply
+ *   probe log FILE
+ *       print each record of a history log, one per line
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "control.h"
+#include "log.h"
+
+#define PROBE_REPLY_LENGTH 65536
+
+static int control(char *command)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  static char reply[PROBE_REPLY_LENGTH];
+  ssize_t len;
+  int fd;
+
+  if (runtime_dir == NULL)
+    errx(EXIT_FAILURE, "XDG_RUNTIME_DIR is not set");
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/" CONTROL_SOCKET_FILE, runtime_dir);
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    err(EXIT_FAILURE, "Could not connect to %s", addr.sun_path);
+  if (send(fd, command, strlen(command), 0) < 0)
+    err(EXIT_FAILURE, "Could not send %s", command);
+  len = recv(fd, reply, sizeof(reply), 0);
+  if (len < 0)
+    err(EXIT_FAILURE, "Could not receive a reply");
+  close(fd);
+
+  fwrite(reply, 1, len, stdout);
+  if (len > 0 && reply[len - 1] != '\n')
+    putchar('\n');
+  return EXIT_SUCCESS;
+}
+
+static int dump_log(char *path)
+{
+  BatsignalLogReader reader;
+  BatsignalLogRecord record;
+  struct stat st;
+  void *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) < 0)
+    err(EXIT_FAILURE, "Could not open %s", path);
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    err(EXIT_FAILURE, "Could not map %s", path);
+  if (!batsignal_log_open(&reader, data, st.st_size))
+    errx(EXIT_FAILURE, "Invalid log %s", path);
+
+  while (batsignal_log_next(&reader, &record)) {
+    printf("battery=%d status=%d energy_now=%lld energy_full=%lld power=%lld\n",
+        record.battery, record.status, (long long)record.energy_now,
+        (long long)record.energy_full, (long long)record.power);
+  }
+  munmap(data, st.st_size);
+  close(fd);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc == 3 && strcmp(argv[1], "control") == 0)
+    return control(argv[2]);
+  if (argc == 3 && strcmp(argv[1], "log") == 0)
+    return dump_log(argv[2]);
+
+  fprintf(stderr, "Usage: %s control COMMAND | log FILE\n", argv[0]);
+  return EXIT_FAILURE;
+}
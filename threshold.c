@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "battery.h"
+#include "estimate.h"
+#include "threshold.h"
+
+static bool energy_warned = false;
+
+static int threshold_max(int unit)
+{
+  switch (unit) {
+    case THRESHOLD_ENERGY:
+      return THRESHOLD_MAX_ENERGY;
+    case THRESHOLD_MINUTES:
+      return THRESHOLD_MAX_MINUTES;
+  }
+  return THRESHOLD_MAX_PERCENT;
+}
+
+/*
+ * Parse a threshold such as "15", "2.5%", "4.5Wh" or "10min". Invalid or out
+ * of range text gives a value of -1, so it is caught by threshold_valid().
+ */
+bool threshold_parse(char *text, Threshold *threshold)
+{
+  char *end;
+  double value = strtod(text, &end);
+  double scale;
+
+  threshold->unit = THRESHOLD_PERCENT;
+  threshold->value = -1;
+  if (end == text || !(value >= 0))
+    return false;
+
+  if (*end == '\0' || strcmp(end, "%") == 0) {
+    scale = 10;
+  } else if (strcasecmp(end, "Wh") == 0) {
+    threshold->unit = THRESHOLD_ENERGY;
+    scale = 1000;
+  } else if (strcmp(end, "m") == 0 || strcmp(end, "min") == 0) {
+    threshold->unit = THRESHOLD_MINUTES;
+    scale = 60;
+  } else {
+    return false;
+  }
+
+  /* bound the value before converting it, so the conversion is defined */
+  if (value * scale > threshold_max(threshold->unit))
+    return false;
+  threshold->value = value * scale + 0.5;
+  return true;
+}
+
+bool threshold_valid(Threshold *threshold)
+{
+  switch (threshold->unit) {
+    case THRESHOLD_PERCENT:
+      return threshold->value >= 0 && threshold->value <= THRESHOLD_MAX_PERCENT;
+    case THRESHOLD_ENERGY:
+      return threshold->value >= 0 && threshold->value <= THRESHOLD_MAX_ENERGY;
+    case THRESHOLD_MINUTES:
+      return threshold->value >= 0 && threshold->value <= THRESHOLD_MAX_MINUTES;
+  }
+  return false;
+}
+
+/*
+ * The threshold as a battery level in tenths of a percent, for the current
+ * capacity and discharge rate. 0 if disabled or the rate is not yet known.
+ */
+int threshold_level(Threshold *threshold, BatteryState *battery)
+{
+  int64_t energy;
+  double rate;
+
+  if (threshold->value == 0 || threshold->unit == THRESHOLD_PERCENT)
+    return threshold->value;
+  if (battery->energy_full <= 0)
+    return 0;
+
+  if (threshold->unit == THRESHOLD_ENERGY) {
+    /* the totals of capacity or unconverted charge batteries are not energy */
+    if (!battery->in_energy) {
+      if (!energy_warned)
+        warnx("Batteries do not report energy, ignoring levels given in Wh");
+      energy_warned = true;
+      return 0;
+    }
+    energy = (int64_t)threshold->value * 1000;
+  } else {
+    rate = estimate_rate();
+    if (rate >= 0)
+      return 0;
+    energy = -rate * threshold->value;
+  }
+
+  /* round up so the threshold is never reached late */
+  energy = (energy * 1000 + battery->energy_full - 1) / battery->energy_full;
+  return energy > 1000 ? 1000 : energy;
+}
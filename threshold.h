@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+/* threshold units and the unit of their value */
+#define THRESHOLD_PERCENT 0 /* tenths of a percent */
+#define THRESHOLD_ENERGY 1  /* mWh */
+#define THRESHOLD_MINUTES 2 /* seconds */
+
+/* largest accepted values */
+#define THRESHOLD_MAX_PERCENT 1000
+#define THRESHOLD_MAX_ENERGY 10000000
+#define THRESHOLD_MAX_MINUTES 86400
+
+/* a value of 0 disables the threshold */
+typedef struct Threshold {
+  int unit;
+  int value;
+} Threshold;
+
+bool threshold_parse(char *text, Threshold *threshold);
+bool threshold_valid(Threshold *threshold);
+int threshold_level(Threshold *threshold, BatteryState *battery);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "battery.h"
+#include "notify.h"
+#include "options.h"
+#include "threshold.h"
+#include "tier.h"
+
+static bool parse_urgency(char *text, int *urgency)
+{
+  if (text[0] == '\0' || strcmp(text, "normal") == 0)
+    *urgency = NOTIFY_URGENCY_NORMAL;
+  else if (strcmp(text, "low") == 0)
+    *urgency = NOTIFY_URGENCY_LOW;
+  else if (strcmp(text, "critical") == 0)
+    *urgency = NOTIFY_URGENCY_CRITICAL;
+  else
+    return false;
+  return true;
+}
+
+/*
+ * Parse LEVEL:HYSTERESIS:URGENCY:MESSAGE:COMMAND, where every field after
+ * LEVEL may be empty or left out. The command is the rest of the text, so it
+ * may contain colons. Invalid text leaves a tier rejected by tier_valid().
+ */
+bool tier_parse(char *text, Tier *tier)
+{
+  char *fields[5] = { text, "", "", "", "" };
+  Threshold hysteresis;
+
+  for (int i = 1; i < 5 && (text = strchr(text, ':')) != NULL; i++) {
+    *text++ = '\0';
+    fields[i] = text;
+  }
+
+  tier->hysteresis = TIER_HYSTERESIS;
+  tier->message = fields[3];
+  tier->command = fields[4];
+  tier->urgency = -1;
+
+  if (!threshold_parse(fields[0], &tier->level))
+    return false;
+  if (fields[1][0] != '\0') {
+    if (!threshold_parse(fields[1], &hysteresis) || hysteresis.unit != THRESHOLD_PERCENT)
+      return false;
+    tier->hysteresis = hysteresis.value;
+  }
+  if (!parse_urgency(fields[2], &tier->urgency))
+    return false;
+
+  tier->state = tier->urgency == NOTIFY_URGENCY_CRITICAL ? STATE_CRITICAL : STATE_WARNING;
+  return true;
+}
+
+bool tier_valid(Tier *tier)
+{
+  return tier->urgency >= 0 && tier->level.value > 0 && threshold_valid(&tier->level) &&
+    tier->hysteresis >= 0 && tier->hysteresis <= THRESHOLD_MAX_PERCENT;
+}
+
+static void add_tier(TierTable *table, Tier *tier, BatteryState *battery)
+{
+  int level = threshold_level(&tier->level, battery);
+  int i;
+
+  /* disabled, or not known yet */
+  if (level <= 0)
+    return;
+
+  /* insert keeping the highest level first */
+  for (i = table->count; i > 0 && table->levels[i - 1] < level; i--) {
+    table->tiers[i] = table->tiers[i - 1];
+    table->levels[i] = table->levels[i - 1];
+  }
+  table->tiers[i] = tier;
+  table->levels[i] = level;
+  table->count++;
+}
+
+/* collect the tiers of config as levels for the current battery state */
+void tier_build(TierTable *table, Config *config, BatteryState *battery)
+{
+  Tier *legacy = table->legacy;
+
+  legacy[0] = (Tier){ config->warning, TIER_HYSTERESIS, NOTIFY_URGENCY_NORMAL, STATE_WARNING,
+    config->warningmsg, "", 0 };
+  legacy[1] = (Tier){ config->critical, TIER_HYSTERESIS, NOTIFY_URGENCY_CRITICAL, STATE_CRITICAL,
+    config->criticalmsg, "", 1 };
+  legacy[2] = (Tier){ config->danger, TIER_HYSTERESIS, NOTIFY_URGENCY_CRITICAL, STATE_DANGER,
+    "", config->dangercmd, 2 };
+
+  table->count = 0;
+  for (int i = 0; i < TIER_LEGACY; i++)
+    add_tier(table, &legacy[i], battery);
+  for (int i = 0; i < config->tier_count && i < TIER_MAX; i++) {
+    config->tiers[i].id = TIER_LEGACY + i;
+    add_tier(table, &config->tiers[i], battery);
+  }
+}
+
+int tier_index(TierTable *table, int id)
+{
+  for (int i = 0; i < table->count; i++) {
+    if (table->tiers[i]->id == id)
+      return i;
+  }
+  return -1;
+}
+
+/*
+ * The most severe tier reached at level, or -1. The active tier is kept
+ * until the level rises above it by more than its hysteresis.
+ */
+int tier_find(TierTable *table, int level, int active)
+{
+  int found = -1;
+  int index = tier_index(table, active);
+
+  for (int i = 0; i < table->count && level <= table->levels[i]; i++)
+    found = i;
+
+  if (index > found && level <= table->levels[index] + table->tiers[index]->hysteresis)
+    found = index;
+  return found;
+}
+
+/* the level of the next tier below index, or 0 if there is none */
+int tier_next_level(TierTable *table, int index)
+{
+  for (int i = index + 1; i < table->count; i++) {
+    if (index < 0 || table->levels[i] < table->levels[index])
+      return table->levels[i];
+  }
+  return 0;
+}
+
+/* the highest level of a critical tier, or 0 */
+int tier_critical_level(TierTable *table)
+{
+  for (int i = 0; i < table->count; i++) {
+    if (table->tiers[i]->urgency == NOTIFY_URGENCY_CRITICAL)
+      return table->levels[i];
+  }
+  return 0;
+}
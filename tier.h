@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdbool.h>
+#include "battery.h"
+#include "threshold.h"
+
+/* custom tiers given with -t */
+#define TIER_MAX 16
+
+/* tiers built from -w, -c and -d come first */
+#define TIER_LEGACY 3
+
+/* default hysteresis, in tenths of a percent */
+#define TIER_HYSTERESIS 10
+
+/* a discharge level with the actions taken when it is reached */
+typedef struct Tier {
+  Threshold level;
+  int hysteresis;
+  int urgency;
+  char state;
+  char *message;
+  char *command;
+  int id;
+} Tier;
+
+/* the tiers for one check, sorted from the highest level down */
+typedef struct TierTable {
+  Tier legacy[TIER_LEGACY];
+  Tier *tiers[TIER_LEGACY + TIER_MAX];
+  int levels[TIER_LEGACY + TIER_MAX];
+  int count;
+} TierTable;
+
+struct Config;
+
+bool tier_parse(char *text, Tier *tier);
+bool tier_valid(Tier *tier);
+void tier_build(TierTable *table, struct Config *config, BatteryState *battery);
+int tier_find(TierTable *table, int level, int active);
+int tier_index(TierTable *table, int id);
+int tier_next_level(TierTable *table, int index);
+int tier_critical_level(TierTable *table);
+
+#endif
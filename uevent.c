@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "battery.h"
+#include "loop.h"
+#include "stats.h"
+#include "uevent.h"
+
+static bool has_battery(BatteryState *battery, const char *name)
+{
+  for (int i = 0; name && i < battery->count; i++) {
+    if (strcmp(name, battery->names[i]) == 0)
+      return true;
+  }
+  return false;
+}
+
+/* system AC adapters, leaving out peripherals that also report online */
+static bool is_adapter(Uevent *event)
+{
+  return event->online &&
+    (strcmp(event->type, "Mains") == 0 || strncmp(event->type, "USB", 3) == 0) &&
+    strcmp(event->scope, "Device") != 0;
+}
+
+/* whether the event needs a battery check, updating discovered batteries */
+static bool handle_event(BatteryState *battery, Uevent *event)
+{
+  /* AC adapters report plug/unplug before the battery status changes */
+  if (is_adapter(event))
+    return true;
+  if (event->name == NULL)
+    return false;
+
+  if (battery->hotplug && strcmp(event->action, "add") == 0)
+    return add_battery(battery, (char *)event->name) || has_battery(battery, event->name);
+  if (battery->hotplug && strcmp(event->action, "remove") == 0)
+    return remove_battery(battery, (char *)event->name);
+  return has_battery(battery, event->name);
+}
+
+static void uevent_handler(int fd, void *data)
+{
+  BatteryState *battery = data;
+  char buf[UEVENT_BUFFER_SIZE + 1];
+  struct sockaddr_nl addr;
+  socklen_t addrlen;
+  ssize_t len;
+  Uevent event;
+  bool matched = false;
+
+  stats.wakeups[STATS_UEVENT]++;
+  for (;;) {
+    addrlen = sizeof(addr);
+    len = recvfrom(fd, buf, UEVENT_BUFFER_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
+    if (len < 0) {
+      /* events were dropped, so assume one of them was ours */
+      if (errno == ENOBUFS)
+        matched = true;
+      else if (errno != EINTR)
+        break;
+      continue;
+    }
+
+    /* only trust messages sent by the kernel */
+    if (addr.nl_pid != 0)
+      continue;
+
+    buf[len] = '\0';
+    if (uevent_parse(buf, len, &event))
+      matched |= handle_event(battery, &event);
+  }
+
+  if (matched)
+    loop_request_check();
+}
+
+void uevent_init(BatteryState *battery)
+{
+  int fd;
+  struct sockaddr_nl addr = {
+    .nl_family = AF_NETLINK,
+    .nl_pid = 0,
+    .nl_groups = 1
+  };
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0)
+    err(EXIT_FAILURE, "Could not open uevent socket");
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    err(EXIT_FAILURE, "Could not bind uevent socket");
+
+  loop_add(fd, uevent_handler, battery);
+}
+
+/* false unless the message is a power supply event */
+bool uevent_parse(const char *buf, size_t len, Uevent *event)
+{
+  const char *end = buf + len;
+  bool power_supply = false;
+
+  event->action = "";
+  event->name = NULL;
+  event->type = "";
+  event->scope = "";
+  event->online = false;
+
+  /* message is a header followed by NUL separated KEY=VALUE pairs */
+  for (const char *p = buf; p < end; p += strnlen(p, end - p) + 1) {
+    if (strcmp(p, UEVENT_SUBSYSTEM) == 0)
+      power_supply = true;
+    else if (strncmp(p, UEVENT_NAME, strlen(UEVENT_NAME)) == 0)
+      event->name = p + strlen(UEVENT_NAME);
+    else if (strncmp(p, UEVENT_ACTION, strlen(UEVENT_ACTION)) == 0)
+      event->action = p + strlen(UEVENT_ACTION);
+    else if (strncmp(p, UEVENT_ONLINE, strlen(UEVENT_ONLINE)) == 0)
+      event->online = true;
+    else if (strncmp(p, UEVENT_TYPE, strlen(UEVENT_TYPE)) == 0)
+      event->type = p + strlen(UEVENT_TYPE);
+    else if (strncmp(p, UEVENT_SCOPE, strlen(UEVENT_SCOPE)) == 0)
+      event->scope = p + strlen(UEVENT_SCOPE);
+  }
+  return power_supply;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2018-2024 Corey Hinshaw
+ */
+
+#ifndef UEVENT_H
+#define UEVENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "battery.h"
+
+#define UEVENT_BUFFER_SIZE 4096
+
+/* kernel uevent keys */
+#define UEVENT_SUBSYSTEM "SUBSYSTEM=power_supply"
+#define UEVENT_NAME "POWER_SUPPLY_NAME="
+#define UEVENT_ONLINE "POWER_SUPPLY_ONLINE="
+#define UEVENT_TYPE "POWER_SUPPLY_TYPE="
+#define UEVENT_SCOPE "POWER_SUPPLY_SCOPE="
+#define UEVENT_ACTION "ACTION="
+
+/* fields of a power supply event, pointing into the message */
+typedef struct Uevent {
+  const char *action;
+  const char *name;
+  const char *type;
+  const char *scope;
+  bool online;
+} Uevent;
+
+void uevent_init(BatteryState *battery);
+bool uevent_parse(const char *buf, size_t len, Uevent *event);
+
+#endif